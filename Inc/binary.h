@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief Header file for the binary host protocol implemented in @ref binary.c
+ *
+ * The binary protocol is an alternative to SLCAN for the link to the PC,
+ * see @ref CANTACT_SET_BINARY_MODE. It transfers records, each of which
+ * is encoded with Consistent Overhead Byte Stuffing (COBS) and terminated by a zero byte.
+ * COBS removes all zero bytes from the record at the cost of one byte,
+ * so a receiver resynchronizes at the next zero byte after a corrupted or truncated record.
+ *
+ * A record starts with a kind byte:
+ *
+ *  bit 7       extended identifier
+ *  bit 6       remote request
+ *  bit 5       reserved, 0
+ *  bit 4       text record
+ *  bits 3-0    DLC (0-8)
+ *
+ * A frame record (bit 4 cleared) continues with the identifier,
+ * 2 bytes for standard and 4 bytes for extended identifiers.
+ * Received frames are followed by the 4 byte timestamp in microseconds, see @ref can_frame_t,
+ * frames to transmit have no timestamp. Data frames end with their DLC data bytes.
+ * All numbers are little-endian. Example: a standard frame with identifier 0x123
+ * and two data bytes 0xAA 0xBB, received at 0x00012345 us:
+ *
+ *  record:     02 23 01 45 23 01 00 AA BB
+ *  encoded:    07 02 23 01 45 23 01 03 AA BB 00
+ *
+ * A text record (kind byte 0x10) carries an SLCAN command including its terminator
+ * from the PC, or a reply to a command to the PC, e.g. 0x10 "qr\r".
+ *
+ * In compressed mode, received frames are sent as compressed frame records
+ * (bit 5 of the kind byte set) instead. Both sides maintain a table of
+ * @ref BINARY_ID_TABLE_LENGTH identifiers and the time of the previous frame,
+ * which start empty resp. at zero with the protocol switch marker.
+ * The kind byte is followed by:
+ *
+ *  slot        bit 7 set: the identifier follows as in a frame record,
+ *                  the PC stores it in the table at the slot number in bits 6-0
+ *              bit 7 cleared: the identifier is the one in the table at this slot
+ *  delta       microseconds since the previous frame, signed: zigzag encoded
+ *              (2d for d >= 0, -2d - 1 for d < 0), then unsigned LEB128
+ *              (7 bits per byte, least significant first, bit 7 set in all but the last byte)
+ *  data        DLC data bytes, for data frames only
+ *
+ * The delta is negative for frames, which the filter policies held back, see @ref filter.h:
+ * they keep their time of reception and may follow younger frames.
+ * The PC adds up the deltas to the device time of each frame, starting from zero;
+ * a gap of 2^31 us (about 35.8 minutes) or more without frames is not recoverable.
+ * host/cantact_binary.py is a reference decoder.
+ *
+ * A standard data frame with 8 bytes, which arrived within 8 ms of the previous frame,
+ * takes 14 bytes including framing, if its identifier is in the table,
+ * compared to 17 bytes uncompressed and 26 bytes in SLCAN with millisecond timestamp.
+ * If its identifier is not in the table, it takes 16 bytes (extended: 18 compared to 19).
+ * The table is direct-mapped, so the identifier savings depend on the number of identifiers
+ * in rotation: with a few hundred identifiers on the bus, most frames miss their slot
+ * and only the time delta saves space.
+ * The compression relies on the PC receiving every record, which the interface to the PC ensures,
+ * apart from garbled bytes on a UART link: select the protocol again to start over.
+ */
+
+#ifndef _BINARY_H
+#define _BINARY_H
+
+#include <stdint.h>
+#include "can.h"
+#include "slcan.h"
+
+#define BINARY_DELIMITER        0x00
+
+#define BINARY_KIND_EXTENDED    0x80
+#define BINARY_KIND_REMOTE      0x40
+#define BINARY_KIND_RESERVED    0x20
+#define BINARY_KIND_TEXT        0x10
+#define BINARY_KIND_DLC         0x0F
+
+/**
+ * Maximum length of an encoded record; the longest record is a text record with a reply:
+ * kind byte, text, COBS code byte and delimiter
+ */
+#define BINARY_MTU              (SLCAN_MTU + 3)
+
+/**
+ * Encodes a received frame as a binary record
+ *
+ * @param frame     Received frame
+ * @param buf       Buffer for the encoded record, at least 19 bytes long
+ * @return Length of the encoded record including the delimiter
+ */
+uint8_t binary_encode_frame(const can_frame_t* frame, uint8_t* buf);
+
+/**
+ * Encodes a received frame as a compressed binary record
+ *
+ * Must be called for every received frame in order, once compression has been started.
+ *
+ * @param frame     Received frame
+ * @param buf       Buffer for the encoded record, at least 21 bytes long
+ * @return Length of the encoded record including the delimiter
+ */
+uint8_t binary_encode_compressed_frame(const can_frame_t* frame, uint8_t* buf);
+
+/**
+ * Starts the compression over: empties the identifier table and resets the previous time to zero
+ */
+void binary_reset_compression(void);
+
+/**
+ * Encodes a reply to a command as a text record
+ *
+ * @param text      Reply including its terminator
+ * @param len       Length of the reply, at most @ref SLCAN_MTU
+ * @param buf       Buffer for the encoded record, at least @ref BINARY_MTU bytes long
+ * @return Length of the encoded record including the delimiter
+ */
+uint8_t binary_encode_text(const uint8_t* text, uint8_t len, uint8_t* buf);
+
+/**
+ * Discards a partially received record
+ */
+void binary_reset(void);
+
+/**
+ * Collects a byte received from the PC into a record
+ * and executes the record as soon as its delimiter arrives
+ *
+ * Frame records are queued for transmission, text records are parsed as SLCAN commands.
+ * Malformed and overlong records are discarded as a whole.
+ */
+void binary_receive(uint8_t byte);
+
+#endif // _BINARY_H
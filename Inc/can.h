@@ -6,6 +6,7 @@
 #ifndef _CAN_H
 #define _CAN_H
 
+#include <stdbool.h>
 #include "stm32f0xx_hal.h"
 #include "can_timing.h"
 
@@ -24,6 +25,52 @@ enum can_bitrate {
     CAN_BITRATE_1000K,
 };
 
+/**
+ * Flags describing the type of a @ref can_frame_t
+ */
+#define CAN_FRAME_FLAG_EXTENDED     0x01
+#define CAN_FRAME_FLAG_REMOTE       0x02
+
+/**
+ * Compact binary representation of a CAN frame
+ *
+ * This is the format in which frames are queued between
+ * the CAN interrupt and the main loop. Conversion to SLCAN
+ * (or any other host encoding) happens only when a frame is
+ * forwarded to the PC, not inside the interrupt.
+ */
+typedef struct {
+    /** Standard (11 bit) or extended (29 bit) identifier */
+    uint32_t id;
+
+    /** Time of reception in microseconds, see @ref now_us; unused for frames to transmit */
+    uint32_t timestamp;
+
+    /** Combination of CAN_FRAME_FLAG_* */
+    uint8_t flags;
+
+    /** Data length code (0-8) */
+    uint8_t dlc;
+
+    /** Payload */
+    uint8_t data[8];
+} can_frame_t;
+
+/**
+ * Transmission statistics since startup;
+ * counters wrap around, so differences between two snapshots should be evaluated
+ */
+typedef struct {
+    /** Frames transmitted successfully */
+    uint32_t transmitted;
+
+    /** Transmissions, which lost arbitration before completing */
+    uint32_t arbitration_lost;
+
+    /** Transmissions, which failed with an error before completing */
+    uint32_t errors;
+} can_tx_statistics_t;
+
 /**
  * List of possible CAN bus states
  */
@@ -57,10 +104,122 @@ void can_set_bitrate(enum can_bitrate bitrate);
  */
 void can_set_filter(uint32_t id, uint32_t mask);
 
+/**
+ * Bit positions within a 32-bit scale filter bank register, see RM0091 p.825
+ */
+#define CAN_FILTER_STID_SHIFT   21
+#define CAN_FILTER_EXID_SHIFT   3
+#define CAN_FILTER_IDE          0x04
+#define CAN_FILTER_RTR          0x02
+
+/**
+ * Bit positions within a 16-bit scale filter, i.e. half a filter bank register;
+ * these filters only apply to standard frames
+ */
+#define CAN_FILTER16_STID_SHIFT 5
+#define CAN_FILTER16_RTR        0x10
+#define CAN_FILTER16_IDE        0x08
+
+/**
+ * Configurations of a filter bank
+ */
+enum can_filter_mode {
+    CAN_FILTER_DISABLED,
+    /** One identifier and mask */
+    CAN_FILTER_MASK_32BIT,
+    /** Two identifiers */
+    CAN_FILTER_LIST_32BIT,
+    /** Two identifiers and masks, lower halves of the registers first */
+    CAN_FILTER_MASK_16BIT,
+    /** Four identifiers, lower halves of the registers first */
+    CAN_FILTER_LIST_16BIT,
+};
+
+/**
+ * Configures one filter bank
+ *
+ * In 32-bit mask mode, fr2 holds the mask for the identifier in fr1.
+ * In 16-bit mask mode, each register holds an identifier in its lower half and its mask in the upper half.
+ *
+ * @param bank      Filter bank number (0-13)
+ * @param mode      Scale and mode of the bank, or disable it
+ * @param fr1       Value for the first filter bank register
+ * @param fr2       Value for the second filter bank register
+ * @param fifo      Reception FIFO to assign accepted frames to
+ */
+void can_configure_filter_bank(uint8_t bank, enum can_filter_mode mode, uint32_t fr1, uint32_t fr2, uint8_t fifo);
+
+/**
+ * Select what happens, when a frame arrives while a hardware reception FIFO is full
+ *
+ * @param locked    Non-zero: FIFO is locked, the new frame is discarded;
+ *                  zero: the oldest frame in the FIFO is overwritten
+ */
+void can_set_rx_overrun_mode(uint8_t locked);
+
 /**
  * Enqueue a frame for transmission
+ *
+ * The transmission queue has a single producer:
+ * This function must only be called from one context,
+ * i.e. the interrupt receiving commands from the PC.
+ *
+ * @param frame     Frame to copy into the transmission queue
+ * @return true     Frame was queued
+ * @return false    Transmission queue is full, frame was discarded
+ */
+bool can_send(const can_frame_t* frame);
+
+/**
+ * Enqueue a received frame for the output to the PC
+ *
+ * The reception queue has a single producer:
+ * This function must only be called at the interrupt priority of the CAN peripheral,
+ * e.g. from the timebase interrupt forwarding a frame held back by a filter policy.
+ *
+ * @param frame     Frame to copy into the reception queue
+ * @return true     Frame was queued
+ * @return false    Off bus or reception queue overrun, frame was discarded
+ */
+bool can_queue_received(const can_frame_t* frame);
+
+/**
+ * Load a frame into an empty transmit mailbox right away, bypassing the transmission queue
+ *
+ * Must only be called from interrupts running at IRQ_PRIORITY_CAN,
+ * as the CAN interrupt accesses the mailboxes as well.
+ * In priority mode, the frame is never aborted in favor of a queued frame.
+ *
+ * @param frame     Frame to transmit
+ * @return true     Transmission was requested
+ * @return false    Off bus or all transmit mailboxes occupied
+ */
+bool can_transmit_immediately(const can_frame_t* frame);
+
+/**
+ * Returns whether the CAN peripheral is on or off bus
+ */
+enum can_bus_state can_get_bus_state(void);
+
+/**
+ * Returns the configured bitrate in bits per second; only valid while on bus
+ */
+uint32_t can_get_bitrate(void);
+
+/**
+ * Retrieve the transmission statistics
+ */
+void can_get_tx_statistics(can_tx_statistics_t* statistics);
+
+/**
+ * Select the order, in which queued frames are transmitted;
+ * only possible while off bus
+ *
+ * @param enabled   Non-zero: by identifier, i.e. the way the frames would win arbitration,
+ *                  with higher priority frames preempting lower priority ones in the transmit mailboxes;
+ *                  zero: in the order they were queued
  */
-void can_send(CanTxMsgTypeDef* frame);
+void can_set_tx_priority_mode(uint8_t enabled);
 
 /**
  * Set the CAN operating mode to silent, i.e. disable transmissions
@@ -11,22 +11,156 @@
 #define IRQ_PRIORITY_UART       2
 #define IRQ_PRIORITY_USB        2
 #define IRQ_PRIORITY_CAN        1
+#define IRQ_PRIORITY_TIMEBASE   1
+
+/*
+ * The timebase alarms (e.g. the cyclic scheduler) and the CAN interrupt
+ * both write to the transmit mailboxes, so they must not preempt each other.
+ */
+#if IRQ_PRIORITY_TIMEBASE != IRQ_PRIORITY_CAN
+#error "IRQ_PRIORITY_TIMEBASE must equal IRQ_PRIORITY_CAN"
+#endif
 
 #define UART_BAUDRATE           460800
 
+/*
+ * All buffers below share the 6 KB of RAM with the USB stack resp. the UART driver
+ * and the 1 KB reserved for the stack (see the linker script); the Nucleo does not link the USB stack.
+ *
+ * CAN_RX_QUEUE_LENGTH and CAN_TX_QUEUE_LENGTH are counted in frames (20 bytes each, see can_frame_t),
+ * all other buffer sizes are counted in bytes and must be powers of two (see fifo_init).
+ */
+
+#ifdef PLATFORM_NUCLEO
+#define UART_TX_BUFFER_SIZE     512
+#define CAN_RX_QUEUE_LENGTH     32
+#define CAN_TX_QUEUE_LENGTH     26
+#endif
+
+#ifdef PLATFORM_CANTACT
+#define CAN_RX_QUEUE_LENGTH     17
+#define CAN_TX_QUEUE_LENGTH     13
+#endif
+
+#ifdef PLATFORM_NUCLEO
+#if (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1)) != 0
+#error "UART_TX_BUFFER_SIZE must be a power of two"
+#endif
+#endif
+
+/**
+ * Time in microseconds, after which a transmission failing with errors is aborted
+ */
+#define CAN_TX_TIMEOUT          2000
+
+/**
+ * Number of entries in the cyclic transmission scheduler (40 bytes each)
+ */
+#ifdef PLATFORM_NUCLEO
+#define CYCLIC_TABLE_LENGTH     12
+#endif
+#ifdef PLATFORM_CANTACT
+#define CYCLIC_TABLE_LENGTH     8
+#endif
+
+/**
+ * Shortest permitted period of a cyclic frame in microseconds,
+ * limits the interrupt load caused by the scheduler
+ */
+#define CYCLIC_MIN_PERIOD       100
+
+/**
+ * Number of records in the playback queue (24 bytes each)
+ */
+#ifdef PLATFORM_NUCLEO
+#define PLAYBACK_QUEUE_LENGTH   12
+#endif
+#ifdef PLATFORM_CANTACT
+#define PLAYBACK_QUEUE_LENGTH   13
+#endif
+
+/**
+ * Delay in microseconds, after which a played back frame is counted as late
+ */
+#define PLAYBACK_LATE_THRESHOLD 100
+
+/**
+ * Size of the buffer for replies to commands, in bytes
+ */
+#define SLCAN_REPLY_BUFFER_SIZE 64
+
+#if (SLCAN_REPLY_BUFFER_SIZE & (SLCAN_REPLY_BUFFER_SIZE - 1)) != 0
+#error "SLCAN_REPLY_BUFFER_SIZE must be a power of two"
+#endif
+
+/**
+ * Number of identifiers and identifier ranges the filter manager accepts (8 bytes each)
+ */
+#define FILTER_TABLE_LENGTH     32
+
+/**
+ * Number of slots in the hash set of extended identifiers of the software filter stage (4 bytes each);
+ * must be a power of two, at most 256. Fill it to about three quarters at most.
+ */
 #ifdef PLATFORM_NUCLEO
-#define UART_RX_BUFFER_SIZE     750
-#define UART_TX_BUFFER_SIZE     750
-#define CAN_RX_BUFFER_SIZE      750
-#define CAN_TX_BUFFER_SIZE      750
+#define FILTER_EXTENDED_SET_LENGTH  64
+#endif
+#ifdef PLATFORM_CANTACT
+#define FILTER_EXTENDED_SET_LENGTH  32
 #endif
 
+#if (FILTER_EXTENDED_SET_LENGTH & (FILTER_EXTENDED_SET_LENGTH - 1)) != 0 || FILTER_EXTENDED_SET_LENGTH > 256
+#error "FILTER_EXTENDED_SET_LENGTH must be a power of two, at most 256"
+#endif
+
+/**
+ * Number of identifiers, whose last frame the per identifier policies remember (16 bytes each);
+ * must be a power of two, from 2 to 512
+ */
+#ifdef PLATFORM_NUCLEO
+#define FRAME_CACHE_LENGTH      16
+#endif
 #ifdef PLATFORM_CANTACT
-#define CAN_RX_BUFFER_SIZE      340
-#define CAN_TX_BUFFER_SIZE      340
+#define FRAME_CACHE_LENGTH      16
+#endif
+
+#if (FRAME_CACHE_LENGTH & (FRAME_CACHE_LENGTH - 1)) != 0 || FRAME_CACHE_LENGTH < 2 || FRAME_CACHE_LENGTH > 512
+#error "FRAME_CACHE_LENGTH must be a power of two, from 2 to 512"
+#endif
+
+/**
+ * Number of frames the rate limit policies hold back at a time (28 bytes each),
+ * one per policy resp. identifier waiting for the end of its interval
+ */
+#define FILTER_HELD_LENGTH      4
+
+/**
+ * Number of identifiers the compressed binary protocol refers to by index (4 bytes each);
+ * must be a power of two, at most 128. Identifiers beyond this number miss their slot
+ * most of the time and are sent in full, see binary.h.
+ */
+#define BINARY_ID_TABLE_LENGTH  32
+
+#if (BINARY_ID_TABLE_LENGTH & (BINARY_ID_TABLE_LENGTH - 1)) != 0 || BINARY_ID_TABLE_LENGTH > 128
+#error "BINARY_ID_TABLE_LENGTH must be a power of two, at most 128"
 #endif
 
-#define CAN_TX_TIMEOUT          20
+/**
+ * Number and size of the buffers for data to the PC via USB;
+ * the count must be a power of two
+ */
+#define USB_TX_BUFFER_COUNT     2
+#define USB_TX_BUFFER_SIZE      128
+
+#if (USB_TX_BUFFER_COUNT & (USB_TX_BUFFER_COUNT - 1)) != 0
+#error "USB_TX_BUFFER_COUNT must be a power of two"
+#endif
+
+/**
+ * Maximum time in microseconds received frames are held back,
+ * while waiting for more frames to fill up a USB packet
+ */
+#define USB_TX_FLUSH_TIMEOUT    1000
 
 #define LED_POWER_ENABLED
 #define LED_ACTIVITY_ENABLED
@@ -35,8 +169,8 @@
 #endif
 
 /**
- * Number of @ref led_process iterations the LED should stay on
+ * Time in microseconds the LED should stay on
  */
-#define LED_ON_DURATION         250
+#define LED_ON_DURATION         25000
 
 #endif
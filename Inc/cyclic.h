@@ -0,0 +1,91 @@
+/**
+ * @file
+ * @brief Header file for the cyclic transmission scheduler implemented in @ref cyclic.c
+ */
+
+#ifndef _CYCLIC_H
+#define _CYCLIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+/**
+ * Byte index value to disable the counter or checksum byte of an entry
+ */
+#define CYCLIC_BYTE_NONE        0xFF
+
+/**
+ * Selects all entries in @ref cyclic_start and @ref cyclic_stop
+ */
+#define CYCLIC_ALL_ENTRIES      0xFF
+
+/**
+ * Set the frame an entry transmits; stops the entry
+ * and disables its counter and checksum byte
+ *
+ * @param index     Entry number
+ * @param frame     Frame to transmit
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t cyclic_set_frame(uint8_t index, const can_frame_t* frame);
+
+/**
+ * Set the timing of an entry; stops the entry
+ *
+ * @param index     Entry number
+ * @param period    Transmission period in microseconds
+ * @param phase     Delay of the first transmission after @ref cyclic_start in microseconds
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t cyclic_set_timing(uint8_t index, uint32_t period, uint32_t phase);
+
+/**
+ * Select payload bytes, which are updated before every transmission of an entry
+ *
+ * The counter byte is incremented by one.
+ * The checksum byte is set to the XOR of all other payload bytes.
+ *
+ * @param index     Entry number
+ * @param counter   Index of the counter byte or @ref CYCLIC_BYTE_NONE
+ * @param checksum  Index of the checksum byte or @ref CYCLIC_BYTE_NONE
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t cyclic_set_update_bytes(uint8_t index, uint8_t counter, uint8_t checksum);
+
+/**
+ * Start transmitting an entry or all configured entries at once,
+ * so that the phases of the entries are relative to a common point in time
+ *
+ * @param index     Entry number or @ref CYCLIC_ALL_ENTRIES
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t cyclic_start(uint8_t index);
+
+/**
+ * Stop transmitting an entry or all entries
+ *
+ * @param index     Entry number or @ref CYCLIC_ALL_ENTRIES
+ */
+void cyclic_stop(uint8_t index);
+
+/**
+ * Stop and remove all entries
+ */
+void cyclic_clear(void);
+
+/**
+ * Transmits the frames which came due, while all transmit mailboxes were occupied
+ *
+ * Called from the CAN interrupt, when transmit mailboxes become empty.
+ * Cyclic frames thereby take precedence over frames queued by the PC.
+ */
+void cyclic_load_pending(void);
+
+/**
+ * Transmits all frames, which came due, and schedules the next alarm;
+ * called from the timebase interrupt
+ */
+void cyclic_alarm(void);
+
+#endif // _CYCLIC_H
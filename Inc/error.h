@@ -13,5 +13,10 @@
 #define ERROR_SLCAN_INVALID_ARGUMENT        12
 #define ERROR_SLCAN_INVALID_BITRATE         13
 #define ERROR_TX_FIFO_OVERRUN               20
+#define ERROR_CYCLIC_INVALID_ENTRY          30
+#define ERROR_CAN_NOT_ON_BUS                31
+#define ERROR_GENERATOR_RUNNING             40
+#define ERROR_FILTER_TABLE_FULL             50
+#define ERROR_FILTER_NOT_FOUND              51
 
 #endif // ERROR_H
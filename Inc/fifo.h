@@ -4,9 +4,35 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "slcan.h"
+#include "stm32f0xx_hal.h"
 
 
+/**
+ * Byte-oriented ring buffer
+ *
+ * The buffer is safe for concurrent use by exactly one producer
+ * (calling only @ref fifo_push) and one consumer (calling only
+ * @ref fifo_pop and the inspection functions), e.g. an interrupt and
+ * the main loop, without disabling interrupts:
+ *
+ * - The push_index is only ever written by the producer,
+ *   the pop_index only by the consumer. No variable is
+ *   read-modify-written by both sides, so the Cortex-M0's lack of
+ *   exclusive access instructions (LDREX/STREX) does not matter.
+ * - Both indices are 16 bit wide and halfword-aligned, so each
+ *   load and store is a single LDRH/STRH, which is single-copy atomic
+ *   and can not be torn by an interrupt.
+ * - Each side works on a local copy of its own index and
+ *   stores it back once, after all data has been copied.
+ *   A memory barrier (@ref __DMB, which also prevents the compiler
+ *   from reordering memory accesses) separates the data accesses
+ *   from the index update, so the other side never observes an index
+ *   covering bytes, which have not yet been written or have not yet been read.
+ * - Each side reads the other side's index exactly once per operation,
+ *   so its decisions are based on a consistent snapshot.
+ *   The snapshot can only be outdated in the safe direction
+ *   (less data available resp. less room available than actually is).
+ */
 typedef struct {
     /**
      * Pointer to data buffer
@@ -14,31 +40,49 @@ typedef struct {
     uint8_t* buffer;
 
     /**
-     * Total size of the linked buffer
+     * Total size of the linked buffer,
+     * must be a power of two
      */
     uint16_t size;
 
     /**
-     * At which byte index to store incoming data
+     * Free-running count of bytes pushed to the buffer;
+     * the byte index to store incoming data at is push_index & (size-1)
      */
     volatile uint16_t push_index;
 
     /**
-     * Index of the next byte to pop from the buffer
+     * Free-running count of bytes popped from the buffer;
+     * the byte index of the next byte to pop is pop_index & (size-1)
      */
     volatile uint16_t pop_index;
+
+    /**
+     * Free-running count of complete records pushed to the buffer
+     */
+    volatile uint16_t push_records;
+
+    /**
+     * Free-running count of records popped from the buffer
+     */
+    volatile uint16_t pop_records;
 } fifo_t;
 
 
 /**
  * Initialize FIFO buffer
+ *
+ * The size must be a power of two (up to 32768),
+ * so that indices can be wrapped with a mask instead of a division,
+ * which the Cortex-M0 can only do in software.
+ * All size bytes can be used.
  */
 void fifo_init(fifo_t* fifo, uint8_t* buffer, uint16_t size);
 
 /**
- * Returns whether there is empty space available in the buffer or not
+ * Returns whether there is room for length more bytes in the buffer or not
  */
-bool fifo_has_room(fifo_t* fifo, uint8_t length);
+bool fifo_has_room(fifo_t* fifo, uint16_t length);
 
 /**
  * Returns whether the buffer has any data stored or not
@@ -50,12 +94,6 @@ bool fifo_is_empty(fifo_t* fifo);
  */
 uint16_t fifo_get_length(fifo_t* fifo);
 
-/**
- * Returns whether the buffer contains at least one complete SLCAN command
- * i.e. a string terminated by a carriage return character
- */
-bool fifo_has_slcan_command(fifo_t* fifo, uint16_t* length);
-
 /**
  * Append data to the buffer
  *
@@ -74,4 +112,50 @@ bool fifo_push(fifo_t* fifo, uint8_t* data, uint16_t length);
  */
 bool fifo_pop(fifo_t* fifo, uint8_t* data, uint16_t length);
 
+
+/*
+ * Record-oriented access
+ *
+ * Records are stored with a one byte length prefix
+ * and a count of complete records is maintained,
+ * so whether a record is available and how long it is
+ * can be answered without scanning the buffer.
+ * A buffer must be accessed either with the record functions
+ * or with the byte-oriented functions above, not both.
+ */
+
+/**
+ * Returns the number of complete records in the buffer
+ */
+uint16_t fifo_get_record_count(fifo_t* fifo);
+
+/**
+ * Returns whether the buffer contains at least one complete record
+ *
+ * @param fifo      Buffer to inspect
+ * @param length    Set to the length of the oldest record
+ */
+bool fifo_has_record(fifo_t* fifo, uint16_t* length);
+
+/**
+ * Append a record to the buffer
+ *
+ * @param fifo      Buffer to push the record to
+ * @param data      Record data
+ * @param length    Record length in bytes
+ * @return true     Record was stored
+ * @return false    Not enough room, nothing was stored
+ */
+bool fifo_push_record(fifo_t* fifo, uint8_t* data, uint8_t length);
+
+/**
+ * Retrieve the oldest record from the buffer
+ *
+ * @param fifo          Buffer to retrieve the record from
+ * @param data          Buffer to write the record to
+ * @param max_length    Size of data; longer records are dropped
+ * @return Length of the retrieved record, zero if none was retrieved
+ */
+uint16_t fifo_pop_record(fifo_t* fifo, uint8_t* data, uint16_t max_length);
+
 #endif
@@ -0,0 +1,246 @@
+/**
+ * @file
+ * @brief Header file for the acceptance filter manager implemented in @ref filter.c
+ */
+
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+/**
+ * Number of filter banks of the bxCAN
+ */
+#define FILTER_BANK_COUNT       14
+
+/**
+ * Number of policies, which entries of the set refer to
+ */
+#define FILTER_POLICY_COUNT     4
+
+/**
+ * What happens to received frames, which an entry with a policy accepted
+ */
+enum filter_action {
+    /** Forward all frames to the PC (default) */
+    FILTER_ACTION_FORWARD,
+    /** Drop all frames */
+    FILTER_ACTION_DROP,
+    /**
+     * Forward at most one frame per interval: the first frame after an interval without frames right away,
+     * else the latest frame of the interval at its end;
+     * up to @ref FILTER_HELD_LENGTH frames are held back at a time, further ones are dropped
+     */
+    FILTER_ACTION_RATE_LIMIT,
+    /**
+     * Forward a frame only if its payload differs from the previous frame with the same identifier,
+     * see @ref frame_cache_entry_t; optionally every Nth unchanged frame as keep-alive.
+     * Identifiers evicted from the cache forward their next frame.
+     */
+    FILTER_ACTION_ON_CHANGE,
+    /** Only count the frames */
+    FILTER_ACTION_COUNT_ONLY,
+    /** Forward every Nth frame, starting with the first one */
+    FILTER_ACTION_DECIMATE,
+    /** Like @ref FILTER_ACTION_RATE_LIMIT, but separately for each identifier, see @ref frame_cache_entry_t */
+    FILTER_ACTION_RATE_LIMIT_ID,
+    /** Like @ref FILTER_ACTION_DECIMATE, but separately for each identifier */
+    FILTER_ACTION_DECIMATE_ID,
+};
+
+/**
+ * Configuration and statistics of a policy
+ */
+typedef struct {
+    enum filter_action action;
+
+    /**
+     * Interval in microseconds for @ref FILTER_ACTION_RATE_LIMIT and @ref FILTER_ACTION_RATE_LIMIT_ID (less than 2^31),
+     * N for @ref FILTER_ACTION_ON_CHANGE: forward every Nth unchanged frame (0: never, at most 255),
+     * N for @ref FILTER_ACTION_DECIMATE and @ref FILTER_ACTION_DECIMATE_ID (at most 255 per identifier)
+     */
+    uint32_t interval;
+
+    /** Number of frames matched since the policy was set, not counted for @ref FILTER_ACTION_DROP */
+    uint32_t frames;
+} filter_policy_status_t;
+
+/**
+ * State of the hardware filters
+ */
+typedef struct {
+    /** Number of identifiers and identifier ranges in the set */
+    uint8_t entries;
+
+    /** Number of filter banks in use */
+    uint8_t banks;
+
+    /**
+     * Whether the banks accept exactly the set;
+     * if not, they accept additional identifiers, as the set did not fit
+     */
+    bool exact;
+
+    /** Whether the software stage is enabled */
+    bool software;
+
+    /** Number of extended identifiers in the software stage */
+    uint8_t software_extended;
+
+    /** Number of frames the software stage dropped since it was enabled */
+    uint32_t software_dropped;
+
+    /** Number of identifiers the per identifier policies evicted from the frame cache since startup */
+    uint32_t cache_evictions;
+
+    /** Number of frames the rate limit policies dropped since startup instead of holding them back, as all slots were taken */
+    uint32_t held_dropped;
+} filter_status_t;
+
+/**
+ * Add identifiers to the set of accepted identifiers
+ *
+ * As long as the set is empty, all frames are accepted.
+ * Takes effect right away, if the channel is open.
+ *
+ * @param extended  Extended instead of standard identifiers
+ * @param first     First identifier of the range
+ * @param last      Last identifier of the range, equal to first for a single identifier
+ * @param policy    Policy for the frames accepted by this entry (0-3); adding an existing entry again changes its policy
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t filter_add(bool extended, uint32_t first, uint32_t last, uint8_t policy);
+
+/**
+ * Remove identifiers, which have been added with exactly the same arguments, from the set
+ *
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t filter_remove(bool extended, uint32_t first, uint32_t last);
+
+/**
+ * Empty the set, i.e. accept all frames
+ */
+void filter_clear(void);
+
+/**
+ * Select whether remote frames with accepted identifiers are received
+ *
+ * List mode banks compare the RTR bit as well, so if remote frames are not needed,
+ * one bank holds twice as many single identifiers.
+ *
+ * @param data_only Only receive data frames
+ */
+void filter_set_data_only(bool data_only);
+
+/**
+ * Retrieve the state of the hardware filters
+ */
+void filter_get_status(filter_status_t* status);
+
+/**
+ * Packs the set into the filter banks and programs them, if the channel is open
+ *
+ * Single identifiers and aligned ranges are packed into list resp. mask mode banks,
+ * standard identifiers at 16 bit scale, extended identifiers at 32 bit scale.
+ * If the banks do not suffice, the closest masks are merged,
+ * until the banks accept a superset as tight as possible.
+ * Called by @ref can_enable.
+ */
+void filter_apply(void);
+
+/**
+ * Enable or disable the software stage
+ *
+ * The software stage checks every frame, which passed the filter banks, against a bitmap
+ * of all standard identifiers and a hash set of extended identifiers, both loaded by the PC.
+ * It lets the PC receive exactly the wanted identifiers, where the banks only accept a superset,
+ * see @ref filter_status_t.exact. Frames not in the tables are dropped in the receive interrupt,
+ * before they take up space in the reception queue.
+ * The tables are kept, while the stage is disabled.
+ *
+ * @param enable    Enable the stage; resets the counter of dropped frames
+ */
+void filter_software_enable(bool enable);
+
+/**
+ * Empty the tables of the software stage, i.e. drop all frames, while it is enabled
+ */
+void filter_software_clear(void);
+
+/**
+ * Write to the bitmap of standard identifiers of the software stage
+ *
+ * Bit n of byte k stands for identifier 8*k+n; set bits let frames pass.
+ *
+ * @param offset    Index of the first byte to write (0-255)
+ * @param bits      Bytes to write
+ * @param length    Number of bytes to write
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t filter_software_set_bitmap(uint8_t offset, const uint8_t* bits, uint8_t length);
+
+/**
+ * Add an extended identifier to the hash set of the software stage
+ *
+ * Identifiers cannot be removed one by one; clear the tables and load them again.
+ *
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t filter_software_add_extended(uint32_t id);
+
+/**
+ * Returns whether the software stage lets a received frame pass;
+ * takes constant time, called from the CAN interrupt
+ */
+bool filter_software_accept(const can_frame_t* frame);
+
+/**
+ * Configure a policy; resets its statistics
+ *
+ * Frames accepted while the set is empty or by the acceptance code and mask (M, m) use policy 0.
+ * If entries with different policies overlap, the priority rules of the filter banks
+ * select the policy of the frames in the overlap.
+ *
+ * @param index     Policy (0-3)
+ * @param action    What happens to the frames
+ * @param interval  Interval resp. keep-alive, see @ref filter_policy_status_t.interval
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t filter_set_policy(uint8_t index, enum filter_action action, uint32_t interval);
+
+/**
+ * Retrieve the configuration and statistics of a policy
+ *
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t filter_get_policy(uint8_t index, filter_policy_status_t* status);
+
+/**
+ * Applies the policy of the filter, which accepted a received frame;
+ * takes constant time, called from the CAN interrupt
+ *
+ * @param fifo      Reception FIFO the frame arrived in
+ * @param number    Filter match index (FMI) of the frame
+ * @return Whether to forward the frame
+ */
+bool filter_policy_accept(uint8_t fifo, uint8_t number, const can_frame_t* frame);
+
+/**
+ * Forwards the frames held back by the rate limit policies, whose interval ended;
+ * called from the timebase interrupt
+ *
+ * The frames keep their time of reception, so they are older than frames received meanwhile.
+ */
+void filter_alarm(void);
+
+/**
+ * Forgets the time of the last forwarded frame of the rate limit policies,
+ * per policy resp. identifier, before the time elapsed since wraps;
+ * to be called from the main loop
+ */
+void filter_process(void);
+
+#endif // _FILTER_H
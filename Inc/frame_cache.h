@@ -0,0 +1,105 @@
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+
+/**
+ * What the per identifier policies remember of an identifier
+ *
+ * The cache holds @ref FRAME_CACHE_LENGTH entries in sets of two.
+ * Each identifier maps to one set, so a lookup compares two keys and takes constant time.
+ * If neither entry of the set holds the identifier, the entry used less recently is evicted.
+ *
+ * An entry keeps the DLC and payload of the last frame, so it takes 16 bytes.
+ * It belongs to the policy, which looked it up, as the policies use it differently:
+ * when the identifier moves to another policy, its entry starts afresh.
+ *
+ * The cache belongs to the CAN interrupt; other contexts may only clear
+ * or expire it, with the interrupt blocked.
+ */
+typedef struct {
+    /**
+     * Identifier, frame type and @ref FRAME_CACHE_VALID; zero if the entry is unused
+     */
+    uint32_t key;
+
+    union {
+        /**
+         * Time of the last forwarded frame, for @ref FILTER_ACTION_RATE_LIMIT_ID
+         */
+        uint32_t time;
+
+        /**
+         * Payload of the last frame, for @ref FILTER_ACTION_ON_CHANGE
+         */
+        uint8_t data[8];
+    };
+
+    /**
+     * DLC of the last frame, for @ref FILTER_ACTION_ON_CHANGE
+     */
+    uint8_t dlc;
+
+    /**
+     * Number of consecutive frames with unchanged payload resp. dropped frames
+     * since the last forwarded frame
+     */
+    uint8_t repeats;
+
+    /**
+     * Policy, which uses the entry
+     */
+    uint8_t policy;
+} frame_cache_entry_t;
+
+#define FRAME_CACHE_VALID       0x40000000
+
+/**
+ * Looks up the entry of a frame's identifier
+ *
+ * If the identifier is not in the cache, evicts an entry and assigns it to the identifier;
+ * its time and repetition counter are zero then. The same applies to an entry of another policy.
+ *
+ * @param frame     Received frame
+ * @param policy    Policy of the identifier
+ * @param found     Set to whether the identifier was in the cache with the given policy
+ * @return Entry of the identifier
+ */
+frame_cache_entry_t* frame_cache_lookup(const can_frame_t* frame, uint8_t policy, bool* found);
+
+/**
+ * Returns the entry of a frame's identifier, NULL if it is not in the cache with the given policy;
+ * neither evicts an entry nor counts as use
+ */
+frame_cache_entry_t* frame_cache_find(const can_frame_t* frame, uint8_t policy);
+
+/**
+ * Returns whether a frame carries the same DLC and payload as the entry
+ */
+bool frame_cache_unchanged(const frame_cache_entry_t* entry, const can_frame_t* frame);
+
+/**
+ * Stores the DLC and payload of a frame in its entry and resets the repetition counter
+ */
+void frame_cache_store(frame_cache_entry_t* entry, const can_frame_t* frame);
+
+/**
+ * Returns the number of identifiers evicted to make room for others since startup
+ */
+uint32_t frame_cache_get_evictions(void);
+
+/**
+ * Removes the entries of a policy, whose time lies 2^31 us or more before the given time,
+ * so the time elapsed since never wraps
+ */
+void frame_cache_expire(uint8_t policy, uint32_t now);
+
+/**
+ * Empties the cache
+ */
+void frame_cache_clear(void);
+
+#endif
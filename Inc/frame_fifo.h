@@ -0,0 +1,105 @@
+
+#ifndef FRAME_FIFO_H
+#define FRAME_FIFO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+
+/**
+ * Ring buffer of fixed-size binary CAN frames
+ *
+ * Like @ref fifo_t, the ring may be used without disabling interrupts
+ * by one producer (e.g. the CAN interrupt) calling @ref frame_fifo_push
+ * and one consumer (e.g. the main loop) calling @ref frame_fifo_pop.
+ * See @ref fifo_t for why this is safe on the Cortex-M0.
+ */
+typedef struct {
+    /**
+     * Pointer to frame storage
+     */
+    can_frame_t* buffer;
+
+    /**
+     * Number of frames the linked storage can hold
+     */
+    uint16_t size;
+
+    /**
+     * Index of the slot to store the next incoming frame in
+     */
+    volatile uint16_t push_index;
+
+    /**
+     * Index of the next frame to pop from the buffer
+     */
+    volatile uint16_t pop_index;
+} frame_fifo_t;
+
+
+/**
+ * Initialize frame FIFO
+ *
+ * @param fifo      Frame FIFO to initialize
+ * @param buffer    Storage for the frames
+ * @param size      Number of elements in buffer;
+ *                  one slot is kept free to tell a full from an empty FIFO
+ */
+void frame_fifo_init(frame_fifo_t* fifo, can_frame_t* buffer, uint16_t size);
+
+/**
+ * Returns whether the FIFO has any frames stored or not
+ */
+bool frame_fifo_is_empty(frame_fifo_t* fifo);
+
+/**
+ * Returns whether there is room for at least one more frame
+ */
+bool frame_fifo_has_room(frame_fifo_t* fifo);
+
+/**
+ * Returns the number of frames currently stored in the FIFO
+ */
+uint16_t frame_fifo_get_length(frame_fifo_t* fifo);
+
+/**
+ * Append a frame to the FIFO
+ *
+ * @param fifo      FIFO to push the frame to
+ * @param frame     Frame to copy into the FIFO
+ * @return true     Frame was stored
+ * @return false    FIFO is full, frame was discarded
+ */
+bool frame_fifo_push(frame_fifo_t* fifo, const can_frame_t* frame);
+
+/**
+ * Returns the oldest frame without removing it from the FIFO
+ *
+ * Together with @ref frame_fifo_commit_pop this allows a frame
+ * to be removed only after it has been handed over successfully,
+ * e.g. to a transport, which may be busy.
+ * The frame remains valid until @ref frame_fifo_commit_pop is called.
+ *
+ * @param fifo      FIFO to inspect
+ * @return Pointer to the oldest frame, NULL if the FIFO is empty
+ */
+can_frame_t* frame_fifo_peek(frame_fifo_t* fifo);
+
+/**
+ * Removes the oldest frame from the FIFO,
+ * after it has been processed via @ref frame_fifo_peek
+ */
+void frame_fifo_commit_pop(frame_fifo_t* fifo);
+
+/**
+ * Retrieve the oldest frame from the FIFO
+ *
+ * @param fifo      FIFO to retrieve the frame from
+ * @param frame     Frame to copy the oldest stored frame to
+ * @return true     A frame was retrieved
+ * @return false    FIFO is empty
+ */
+bool frame_fifo_pop(frame_fifo_t* fifo, can_frame_t* frame);
+
+#endif
@@ -0,0 +1,110 @@
+
+#ifndef FRAME_HEAP_H
+#define FRAME_HEAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+
+/**
+ * Priority queue of CAN frames, ordered the way
+ * the frames would win arbitration on the bus
+ *
+ * The frame with the lowest identifier is always on top;
+ * a standard frame beats an extended frame with the same base identifier
+ * and a data frame beats a remote request with the same identifier.
+ * Frames with equal identifiers leave the queue in the order they were pushed.
+ * For this purpose the timestamp field of the stored frames is
+ * overwritten with a sequence number.
+ *
+ * Implemented as a binary min-heap, so that
+ * push and pop take O(log n) and peek O(1).
+ *
+ * Unlike @ref frame_fifo_t, the heap must not be accessed
+ * concurrently; callers have to serialize all accesses.
+ */
+typedef struct {
+    /**
+     * Pointer to frame storage
+     */
+    can_frame_t* buffer;
+
+    /**
+     * Number of frames the linked storage can hold
+     */
+    uint16_t size;
+
+    /**
+     * Number of frames currently stored
+     */
+    volatile uint16_t length;
+
+    /**
+     * Sequence number to assign to the next pushed frame
+     */
+    uint16_t sequence;
+} frame_heap_t;
+
+
+/**
+ * Computes a key for a frame, which sorts like the arbitration field on the bus,
+ * i.e. the frame with the lower key wins arbitration
+ */
+uint32_t can_arbitration_key(const can_frame_t* frame);
+
+/**
+ * Initialize frame heap
+ *
+ * @param heap      Frame heap to initialize
+ * @param buffer    Storage for the frames
+ * @param size      Number of elements in buffer
+ */
+void frame_heap_init(frame_heap_t* heap, can_frame_t* buffer, uint16_t size);
+
+/**
+ * Returns whether the heap has any frames stored or not
+ */
+bool frame_heap_is_empty(frame_heap_t* heap);
+
+/**
+ * Returns the number of frames currently stored in the heap
+ */
+uint16_t frame_heap_get_length(frame_heap_t* heap);
+
+/**
+ * Insert a frame into the heap
+ *
+ * @param heap      Heap to push the frame to
+ * @param frame     Frame to copy into the heap
+ * @return true     Frame was stored
+ * @return false    Heap is full, frame was discarded
+ */
+bool frame_heap_push(frame_heap_t* heap, const can_frame_t* frame);
+
+/**
+ * Re-insert a frame, which was previously taken from the heap,
+ * keeping its original position among frames with the same identifier
+ *
+ * @param heap      Heap to return the frame to
+ * @param frame     Frame as retrieved via @ref frame_heap_peek
+ * @return true     Frame was stored
+ * @return false    Heap is full, frame was discarded
+ */
+bool frame_heap_requeue(frame_heap_t* heap, const can_frame_t* frame);
+
+/**
+ * Returns the highest priority frame without removing it from the heap
+ *
+ * @param heap      Heap to inspect
+ * @return Pointer to the frame, NULL if the heap is empty;
+ *         valid until the heap is modified
+ */
+can_frame_t* frame_heap_peek(frame_heap_t* heap);
+
+/**
+ * Removes the highest priority frame from the heap
+ */
+void frame_heap_remove_top(frame_heap_t* heap);
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Header file for the bus load generator implemented in @ref generator.c
+ */
+
+#ifndef _GENERATOR_H
+#define _GENERATOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+/**
+ * How the generator varies identifiers and payload from frame to frame
+ */
+enum generator_pattern {
+    /** Always the same value: the lower bound resp. the configured payload */
+    GENERATOR_PATTERN_FIXED,
+    /** Incrementing: identifiers cycle through the range, the payload is a little-endian counter */
+    GENERATOR_PATTERN_INCREMENT,
+    /** Pseudo-random within the range resp. random payload bytes */
+    GENERATOR_PATTERN_RANDOM,
+};
+
+/**
+ * Generator statistics since the generator was last started
+ */
+typedef struct {
+    /** Whether the generator is running */
+    bool running;
+
+    /** Number of generated frames, which were loaded into a transmit mailbox */
+    uint32_t frames;
+
+    /** Frames per second actually achieved, averaged since start */
+    uint32_t rate;
+
+    /** Number of transmissions, which lost arbitration before completing */
+    uint32_t arbitration_lost;
+
+    /** Number of transmissions, which failed with an error before completing */
+    uint32_t errors;
+} generator_status_t;
+
+/**
+ * Configure the identifiers of the generated frames; only while stopped
+ *
+ * @param pattern   How the identifier changes from frame to frame
+ * @param extended  Generate extended instead of standard frames
+ * @param min       Lowest identifier
+ * @param max       Highest identifier
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t generator_set_id(enum generator_pattern pattern, bool extended, uint32_t min, uint32_t max);
+
+/**
+ * Configure the range of DLCs of the generated frames; only while stopped
+ *
+ * For different values, each frame gets a random DLC within the range.
+ *
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t generator_set_dlc(uint8_t min, uint8_t max);
+
+/**
+ * Configure the payload of the generated frames; only while stopped
+ *
+ * @param pattern   How the payload changes from frame to frame
+ * @param data      Payload for @ref GENERATOR_PATTERN_FIXED, start value for @ref GENERATOR_PATTERN_INCREMENT
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t generator_set_payload(enum generator_pattern pattern, const uint8_t data[8]);
+
+/**
+ * Pace the generator to a frame rate; only while stopped
+ *
+ * @param rate      Frames per second; zero keeps the transmit mailboxes filled at all times
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t generator_set_rate(uint32_t rate);
+
+/**
+ * Pace the generator to a bus load; only while stopped
+ *
+ * The load is computed from the nominal frame lengths, i.e. without stuff bits.
+ *
+ * @param load      Bus load in percent (1-100)
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t generator_set_load(uint8_t load);
+
+/**
+ * Start generating frames; resets the statistics, requires the channel to be open
+ */
+void generator_start(void);
+
+/**
+ * Stop generating frames
+ */
+void generator_stop(void);
+
+/**
+ * Retrieve the generator statistics
+ */
+void generator_get_status(generator_status_t* status);
+
+/**
+ * Loads generated frames into empty transmit mailboxes;
+ * called from the CAN interrupt, when transmit mailboxes become empty
+ */
+void generator_load_pending(void);
+
+/**
+ * Generates the frames, which came due, and schedules the next alarm;
+ * called from the timebase interrupt
+ */
+void generator_alarm(void);
+
+#endif // _GENERATOR_H
@@ -50,7 +50,7 @@ void led_on(led_index_t);
 void led_off(led_index_t);
 
 /**
- * Switches the LED off after @ref LED_ON_DURATION iterations
+ * Switches the LED off after @ref LED_ON_DURATION
  */
 void led_process();
 
@@ -0,0 +1,70 @@
+/**
+ * @file
+ * @brief Header file for the timed playback implemented in @ref playback.c
+ */
+
+#ifndef _PLAYBACK_H
+#define _PLAYBACK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can.h"
+
+/**
+ * Playback statistics
+ */
+typedef struct {
+    /** Whether playback is running */
+    bool running;
+
+    /** Number of records waiting for their time */
+    uint16_t queued;
+
+    /** Number of records, which arrived after their time had already passed */
+    uint32_t underruns;
+
+    /** Number of frames loaded into a mailbox more than PLAYBACK_LATE_THRESHOLD after their time */
+    uint32_t late;
+} playback_status_t;
+
+/**
+ * Append a frame to the playback queue
+ *
+ * Must only be called from one context, i.e. the interrupt receiving commands from the PC.
+ *
+ * @param time      Transmission time in microseconds after @ref playback_start
+ * @param frame     Frame to transmit
+ * @return Zero if successful, other values indicate an error, see \ref error.h
+ */
+int8_t playback_push(uint32_t time, const can_frame_t* frame);
+
+/**
+ * Start releasing the queued frames; resets the statistics
+ *
+ * Records may be queued before and while playback is running.
+ */
+void playback_start(void);
+
+/**
+ * Stop playback and discard all queued records
+ */
+void playback_stop(void);
+
+/**
+ * Retrieve the playback statistics
+ */
+void playback_get_status(playback_status_t* status);
+
+/**
+ * Transmits the frame, which came due while all transmit mailboxes were occupied;
+ * called from the CAN interrupt, when transmit mailboxes become empty
+ */
+void playback_load_pending(void);
+
+/**
+ * Transmits all frames, which came due, and schedules the next alarm;
+ * called from the timebase interrupt
+ */
+void playback_alarm(void);
+
+#endif // _PLAYBACK_H
@@ -9,18 +9,27 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "stm32f0xx_hal.h"
+#include "can.h"
 
 
 /**
  * The maximum transfer unit (MTU),
  * i.e. the maximum number of bytes possible in one SLCAN message,
- * is the length of an extended CAN frame with timestamp:
+ * is the length of an extended CAN frame with host timestamp:
  *
- *  sizeof("T1111222281122334455667788EA5F\r")+1
+ *  strlen("T111122228112233445566778800056789ABCDEF01\r")
  *
  * See also the can-utils project -> slcanpty.c
  */
-#define SLCAN_MTU 30
+#define SLCAN_MTU 43
+
+/**
+ * Maximum length of a command from the PC including the terminator;
+ * the longest command is a playback record with an extended transmit command:
+ *
+ *  strlen("q11223344T1111222281122334455667788\r")
+ */
+#define SLCAN_COMMAND_MAX_LENGTH 36
 
 /** Length of the standard CAN ID */
 #define SLCAN_STD_ID_LEN 3
@@ -77,6 +86,14 @@ enum slcan_message_type {
     CANTACT_SET_MODE2 = 'M',
     CANTACT_SET_FILTER = 'F',
     CANTACT_SET_MASK = 'K',
+    CANTACT_SET_RX_OVERRUN_MODE = 'o',
+    CANTACT_SET_TX_PRIORITY_MODE = 'p',
+    CANTACT_CYCLIC = 'c',
+    CANTACT_PLAYBACK = 'q',
+    CANTACT_GENERATOR = 'g',
+    CANTACT_CLOCK_SYNC = 'y',
+    CANTACT_SET_BINARY_MODE = 'B',
+    CANTACT_FILTER = 'a',
 
     USBTIN_OPEN_LOOPBACK = 'I',
     USBTIN_OPEN_LISTEN_ONLY = 'L',
@@ -86,14 +103,215 @@ enum slcan_message_type {
     MICTRONICS_GET_ERROR = 'E',
 };
 
+/**
+ * Format of the timestamps appended to received frames, see @ref SLCAN_SET_TIMESTAMPING
+ */
+enum slcan_timestamp_mode {
+    /** No timestamp */
+    SLCAN_TIMESTAMP_OFF,
+    /** Milliseconds modulo 60000 as 4 hexadecimal digits, as specified by Lawicel */
+    SLCAN_TIMESTAMP_MILLISECONDS,
+    /** Microseconds modulo 2^32 as 8 hexadecimal digits (CANtact extension) */
+    SLCAN_TIMESTAMP_MICROSECONDS,
+    /** Microseconds of the host's clock as 16 hexadecimal digits, see @ref CANTACT_CLOCK_SYNC (CANtact extension) */
+    SLCAN_TIMESTAMP_HOST,
+};
+
+/**
+ * Protocols to and from the PC, see @ref CANTACT_SET_BINARY_MODE
+ */
+enum slcan_protocol {
+    SLCAN_PROTOCOL_TEXT,
+    SLCAN_PROTOCOL_BINARY,
+    SLCAN_PROTOCOL_COMPRESSED,
+};
+
+/**
+ * @var SLCAN_SET_TIMESTAMPING
+ * Selects the timestamp appended to each received frame,
+ * e.g. t1232AABB1F3C for a frame received at 7996 ms:
+ *
+ *  Z0      no timestamp
+ *  Z1      milliseconds (0000-EA5F)
+ *  Z2      microseconds (00000000-FFFFFFFF)
+ *  Z3      microseconds of the host's clock (16 digits), see @ref CANTACT_CLOCK_SYNC
+ *
+ * The frames are timestamped upon reception by the CAN interrupt,
+ * so the timestamps are not affected by the latency of the interface to the PC.
+ */
+
+/**
+ * @var CANTACT_SET_BINARY_MODE
+ * Selects the protocol to and from the PC:
+ *
+ *  B0      SLCAN (default)
+ *  B1      binary protocol, see @ref binary.h
+ *  B2      binary protocol, received frames compressed
+ *
+ * The device expects the new protocol right after the command's terminator.
+ * In binary mode, SLCAN commands are sent as text records, so B0 returns to SLCAN.
+ * Before the first output in the new protocol, the device sends a single zero byte,
+ * which never occurs in SLCAN messages and is an empty record in the binary protocol.
+ * Everything before it belongs to the previous protocol.
+ * The state of the compression starts over with this marker.
+ */
+
+/**
+ * @var CANTACT_FILTER
+ * Edits the set of accepted identifiers, see @ref filter.h; all numbers are hexadecimal,
+ * E selects standard (0) or extended (1) identifiers:
+ *
+ *  aaEIIIIIIII[P]          add identifier I
+ *  aaEFFFFFFFFLLLLLLLL[P]  add identifiers F to L;
+ *                          P: policy (0-3) of the entry, default 0, adding an entry again changes it
+ *  adEIIIIIIII             delete an identifier resp. a range added before
+ *  adEFFFFFFFFLLLLLLLL
+ *  ac                      clear the set, i.e. accept all frames
+ *  aoD                     D=1: only receive data frames, which doubles the capacity for single identifiers,
+ *                          D=0: receive data and remote frames (default)
+ *  ar                      report, reply: aNNBBX
+ *                          N: identifiers and ranges in the set, B: filter banks in use,
+ *                          X: 1 if the banks accept exactly the set, 0 if additional identifiers pass
+ *
+ * The set persists, when the channel is closed.
+ * The acceptance code and mask commands (M, m) clear the set.
+ *
+ * The software stage drops frames, which passed the banks, unless their identifier
+ * is in its tables, so the PC receives exactly the identifiers it loaded:
+ *
+ *  asD                     D=1: enable, D=0: disable the software stage (default)
+ *  ae                      empty the tables
+ *  abOOHH..HH              write 1-8 bytes of the bitmap of standard identifiers, starting at byte O;
+ *                          bit n of byte k stands for identifier 8*k+n
+ *  axIIIIIIII..IIIIIIII    add 1-4 extended identifiers
+ *  as                      report, reply: asXNNDDDDDDDD
+ *                          X: 1 if enabled, N: extended identifiers loaded,
+ *                          D: frames dropped since enabled
+ *
+ * Loading the whole bitmap takes 32 commands, which may be sent back-to-back.
+ *
+ * Policies decide in the receive interrupt what happens to the frames of their entries,
+ * found by the filter match index of each frame, i.e. without searching:
+ *
+ *  apPA[IIIIIIII]          configure policy P (0-3) to action A (hex):
+ *                          A=0: forward (default), A=1: drop,
+ *                          A=2: forward at most one frame per interval, I: interval in microseconds (below 80000000);
+ *                               the latest frame of an interval is forwarded at its end,
+ *                          A=3: forward a frame only if its payload differs from the previous frame
+ *                               with the same identifier, I: also forward every Ith unchanged frame (0-FF),
+ *                          A=4: count only,
+ *                          A=5: forward every Ith frame, starting with the first one,
+ *                          A=6: like A=2, but for each identifier on its own,
+ *                          A=7: like A=5, but for each identifier on its own (I: 0-FF)
+ *  aqP                     report, reply: aqPAFFFFFFFF, F: frames matched since configured
+ *                          (not counted when dropping)
+ *
+ *  ai                      report the frame cache, reply: aiLLLLEEEEEEEEDDDDDDDD
+ *                          L: identifiers the per identifier actions track at a time,
+ *                          E: identifiers evicted to make room for others,
+ *                          D: frames A=2 and A=6 dropped, as FILTER_HELD_LENGTH frames were held back already
+ *
+ * While the set is empty, policy 0 applies to all frames, e.g. ap03 forwards only changes.
+ * The per identifier actions track up to FRAME_CACHE_LENGTH identifiers at a time;
+ * frames of an identifier, which has been evicted, are forwarded as if it was new.
+ * A steadily growing E means the bus carries more identifiers than the cache holds.
+ * Held back frames carry their time of reception, so their timestamp may be older
+ * than the one of the frame before.
+ */
+
+/**
+ * @var CANTACT_CYCLIC
+ * Configures the cyclic transmission scheduler, see @ref cyclic.h.
+ * The second character selects the operation,
+ * S is the entry number (one hexadecimal digit), all numbers are hexadecimal:
+ *
+ *  cfS<t, T, r or R command>   set the frame of an entry, e.g. cf0t1232AABB
+ *  cpSPPPPPPPPHHHHHHHH         set period P and phase H of an entry in microseconds
+ *  cbSKX                       increment byte K and set byte X to the XOR of the other bytes
+ *                              before each transmission; '0' to '7' or '-' for none
+ *  csS                         start an entry, cs* starts all entries with a common phase reference
+ *  cxS                         stop an entry, cx* stops all entries
+ *  cc                          remove all entries
+ *
+ * Entries are stopped, when the channel is closed.
+ */
+
+/**
+ * @var CANTACT_PLAYBACK
+ * Controls the timed playback, see @ref playback.h; all numbers are hexadecimal:
+ *
+ *  qTTTTTTTT<t, T, r or R command>     queue a frame for transmission T microseconds after playback start
+ *  qs                                  start playback; frames may be queued before and during playback
+ *  qx                                  stop playback and discard all queued frames
+ *  qr                                  report status, reply: qRNNNNUUUUUUUULLLLLLLL
+ *                                      R: 1 if running, N: queued frames,
+ *                                      U: frames queued after their time had passed (underruns),
+ *                                      L: frames transmitted late
+ *
+ * The PC should keep the queue filled, polling the number of queued frames with qr.
+ * Playback is stopped, when the channel is closed.
+ */
+
+/**
+ * @var CANTACT_GENERATOR
+ * Controls the bus load generator, see @ref generator.h; all numbers are hexadecimal.
+ * Patterns P: 0 fixed, 1 incrementing, 2 random.
+ *
+ *  giPEAAAAAAAABBBBBBBB    identifiers from A to B with pattern P, E: 0 standard, 1 extended frames
+ *  gdLH                    DLCs from L to H
+ *  gpPDDDDDDDDDDDDDDDD     payload pattern P with data D (fixed value resp. counter start)
+ *  gfRRRRRRRR              pace to R frames per second, 0: keep all mailboxes filled
+ *  glLL                    pace to a bus load of L percent (01-64)
+ *  gs                      start; requires the channel to be open
+ *  gx                      stop
+ *  gr                      report status, reply: gRFFFFFFFFAAAAAAAAEEEEEEEE
+ *                          R: 1 if running, F: achieved frames per second,
+ *                          A: transmissions which lost arbitration, E: transmission errors
+ *
+ * Configuration is only possible while the generator is stopped.
+ * The generator is stopped, when the channel is closed.
+ * host/cantact_generator.py configures and runs the generator from the command line.
+ */
+
+/**
+ * @var CANTACT_CLOCK_SYNC
+ * Synchronizes the device clock to the host's clock; all numbers are hexadecimal microseconds:
+ *
+ *  ypHHHHHHHHHHHHHHHH                  ping with host time H, reply: yHHHHHHHHHHHHHHHHDDDDDDDDDDDDDDDD
+ *                                      echoing H with the device time D at reception
+ *  ycOOOOOOOOOOOOOOOORRRRRRRR          set the host clock relative to the last ping:
+ *                                      offset O (signed) and drift R (signed, parts per billion)
+ *
+ * All device times, including the timestamps of received frames, count from startup without wrapping around,
+ * i.e. the 8 digit timestamps (Z2) are the lower 32 bits of the device time.
+ *
+ * The host estimates offset and drift like NTP:
+ *  1. Send a ping with the current host time T1 about once per second.
+ *  2. On the reply, take the host time T4; the round trip time is T4 - T1.
+ *     The device time D corresponds to the host time (T1 + T4) / 2,
+ *     so the offset is (T1 + T4) / 2 - D, accurate to half of the round trip time.
+ *  3. Of several consecutive pings keep the one with the shortest round trip time,
+ *     as USB and host scheduling only ever add delay.
+ *  4. Fit a line to the kept offsets over D, e.g. by least squares over the last minutes:
+ *     the slope is the drift, the line's value at the device time of the last ping is the offset.
+ * Device times can then be converted on the host as: D + O + (D - D_ping) * R / 10^9.
+ * host/cantact_sync.py is a reference implementation of the host side.
+ *
+ * Alternatively, the host hands its estimate to the device with yc after each ping,
+ * and the device timestamps frames in host time (Z3).
+ * The estimate applies from the device time of the last ping, which the host knows from the reply.
+ */
+
 
 /**
- * @brief  Parses CAN frame and generates SLCAN message
- * @param  buf:   Pointer to SLCAN message buffer
- * @param  frame: Pointer to CAN frame received from CAN interface
+ * @brief  Parses CAN frame and generates SLCAN message, resp. a binary record in binary mode
+ * @param  buf:   Pointer to SLCAN message buffer, at least @ref SLCAN_MTU bytes long
+ * @param  frame: Pointer to CAN frame taken from the reception queue
  * @return Number of bytes in generated SLCAN message
+ *
+ * Must only be called from the main loop.
  */
-int8_t slcan_parse_frame(CanRxMsgTypeDef* frame, uint8_t* buf);
+int8_t slcan_parse_frame(can_frame_t* frame, uint8_t* buf);
 
 
 /**
@@ -105,16 +323,62 @@ int8_t slcan_parse_frame(CanRxMsgTypeDef* frame, uint8_t* buf);
 int8_t slcan_parse_command(uint8_t *buf, uint8_t len);
 
 
+/**
+ * Collects bytes received from the PC into SLCAN commands
+ * and parses each command as soon as its terminator arrives
+ *
+ * Each byte is handled in constant time;
+ * overlong commands are discarded as a whole.
+ *
+ * @param buf   Received bytes
+ * @param len   Number of received bytes
+ */
+void slcan_receive(uint8_t* buf, uint16_t len);
+
+
+/**
+ * Hands a string over to the interface to the PC
+ *
+ * Must only be called from the main loop.
+ *
+ * @param buf   String to send
+ * @param len   Length of the string
+ * @return Whether the string was accepted; if not, the interface is busy
+ */
+bool slcan_output(uint8_t* buf, uint16_t len);
+
+/**
+ * Converts a received frame for the PC and hands it over to the interface to the PC
+ *
+ * Must only be called from the main loop.
+ * If the interface is busy, the frame must be passed again on the next call,
+ * as it has been converted already.
+ *
+ * @param frame     Received frame
+ * @return Whether the frame was accepted
+ */
+bool slcan_output_frame(can_frame_t* frame);
+
+/**
+ * Sends pending replies to commands and flushes the output to the PC;
+ * called from the main loop
+ */
+void slcan_process(void);
+
+
 /**
  * Generates a CAN frame according to an SLCAN transmit command
  *
+ * The command is fully validated: identifier range, DLC,
+ * hexadecimal digits and the exact length including the terminator.
+ *
  * @param buffer    Pointer to SLCAN string
- * @param length    Length of SLCAN string
+ * @param length    Length of SLCAN string, including the terminator
  * @param frame     Pointer to CAN frame structure to configure according to SLCAN string
  * @return true     Parser success
  * @return false    Failed to configure frame according to SLCAN string
  */
-bool slcan_parse_transmit_command(uint8_t* buffer, uint16_t length, CanTxMsgTypeDef* frame);
+bool slcan_parse_transmit_command(uint8_t* buffer, uint16_t length, can_frame_t* frame);
 
 
 #endif // _SLCAN_H
@@ -0,0 +1,124 @@
+/**
+ * @file
+ * @brief Header file for the microsecond timebase implemented in @ref timebase.c
+ */
+
+#ifndef _TIMEBASE_H
+#define _TIMEBASE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "stm32f0xx_hal.h"
+
+/**
+ * Timer providing the timebase; TIM2 is the only 32 bit timer of the STM32F042
+ */
+#define TIMEBASE_TIMER          TIM2
+#define TIMEBASE_IRQ            TIM2_IRQn
+
+/**
+ * Compare channels of the timebase timer, which can be used as alarms
+ */
+enum timebase_alarm {
+    TIMEBASE_ALARM_CYCLIC,
+    TIMEBASE_ALARM_PLAYBACK,
+    TIMEBASE_ALARM_GENERATOR,
+    TIMEBASE_ALARM_FILTER,
+};
+
+/**
+ * Start the free-running 1 MHz timebase
+ */
+void timebase_init(void);
+
+/**
+ * Returns the current time in microseconds
+ *
+ * The value wraps around after 2^32 us (about 71.6 minutes),
+ * so time spans must be computed as the unsigned difference of two values.
+ */
+static inline uint32_t now_us(void)
+{
+    return TIMEBASE_TIMER->CNT;
+}
+
+/**
+ * Returns the current time in microseconds since startup
+ *
+ * Extends the 32 bit counter by the number of wraparounds, so the value never wraps around.
+ * May be called from any context, including interrupts which block the timebase interrupt.
+ */
+uint64_t now_us64(void);
+
+/**
+ * Extends a point in time in the past to 64 bits, see @ref now_us64
+ *
+ * Valid for points in time less than 2^32 us in the past,
+ * e.g. the timestamp of a received frame, which has been queued meanwhile.
+ */
+static inline uint64_t timebase_extend(uint32_t time)
+{
+    uint64_t now = now_us64();
+    return now - (uint32_t) ((uint32_t) now - time);
+}
+
+/**
+ * Relate the device time to the host's clock, see @ref timebase_to_host
+ *
+ * The host estimates offset and drift from the exchange of timestamps
+ * and updates them periodically.
+ *
+ * @param reference Device time, at which the offset has been estimated, see @ref now_us64
+ * @param offset    Host time minus device time at the reference time in microseconds
+ * @param drift     Rate of the host clock relative to the device clock in parts per billion
+ */
+void timebase_set_host_clock(uint64_t reference, int64_t offset, int32_t drift);
+
+/**
+ * Converts a device time to the host's clock, see @ref timebase_set_host_clock
+ *
+ * Until the host clock has been set, the device time is returned unchanged.
+ *
+ * @param time      Device time, see @ref now_us64
+ * @return Host time in microseconds
+ */
+uint64_t timebase_to_host(uint64_t time);
+
+/**
+ * Returns whether a point in time has been reached
+ *
+ * Valid for points in time less than 2^31 us in the past or future.
+ */
+static inline bool timebase_is_due(uint32_t time, uint32_t now)
+{
+    return ((int32_t) (now - time) >= 0);
+}
+
+/**
+ * Schedule an alarm
+ *
+ * When the given time is reached, the timer interrupt
+ * invokes the respective module's alarm handler.
+ * If the time has already passed, the interrupt is triggered right away.
+ * Re-scheduling replaces the previous time.
+ * Must not be interrupted by another call of this function or @ref timebase_cancel_alarm,
+ * i.e. be called at IRQ_PRIORITY_TIMEBASE or with interrupts disabled.
+ *
+ * @param alarm     Alarm to schedule
+ * @param time      Time in microseconds, see @ref now_us
+ */
+void timebase_set_alarm(enum timebase_alarm alarm, uint32_t time);
+
+/**
+ * Trigger a scheduled alarm right away
+ *
+ * Unlike @ref timebase_set_alarm, this may be called from any interrupt priority.
+ */
+void timebase_trigger_alarm(enum timebase_alarm alarm);
+
+/**
+ * Cancel an alarm
+ */
+void timebase_cancel_alarm(enum timebase_alarm alarm);
+
+#endif // _TIMEBASE_H
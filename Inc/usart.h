@@ -23,6 +23,8 @@ int _read(int file, char *ptr, int len);
  * @param file: File/pipe to write to; here disregarded
  * @param ptr:  Pointer to buffer to write to UART
  * @param len:  Length of write buffer in bytes
+ * @return Number of bytes written: either len or,
+ *         if the transmission buffer has not enough room, zero
  */
 int _write(int file, char *ptr, int len);
 
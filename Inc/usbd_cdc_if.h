@@ -51,6 +51,9 @@ extern USBD_CDC_ItfTypeDef  USBD_Interface_fops_FS;
   * @{
   */ 
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
+uint8_t CDC_Enqueue_FS(uint8_t* Buf, uint16_t Len);
+uint8_t CDC_Flush_FS(void);
+void CDC_Process_FS(void);
 
 /**
   * @}
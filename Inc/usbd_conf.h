@@ -40,6 +40,11 @@
 #include <string.h>
 #include "stm32f0xx.h"
 #include "stm32f0xx_hal.h"
+
+/* Endpoint numbers in use: control (0), CDC data (1) and CDC command (2);
+ * defined before usbd_def.h, which sizes the device handle with it */
+#define USBD_MAX_NUM_ENDPOINTS     3
+
 #include "usbd_def.h"
 
 /** @addtogroup USBD_OTG_DRIVER
@@ -60,7 +65,7 @@
 /*---------- -----------*/
 #define USBD_MAX_NUM_CONFIGURATION     1
 /*---------- -----------*/
-#define USBD_MAX_STR_DESC_SIZ     512
+#define USBD_MAX_STR_DESC_SIZ     128
 /*---------- -----------*/
 #define USBD_SUPPORT_USER_STRING     0
 /*---------- -----------*/
@@ -70,7 +75,11 @@
 /*---------- -----------*/
 #define USBD_CDC_INTERVAL     1000
 /*---------- -----------*/
-#define MAX_STATIC_ALLOC_SIZE     256
+/* Longest class request data stage: SET_LINE_CODING (7 bytes) */
+#define CDC_REQUEST_DATA_SIZE     16
+/*---------- -----------*/
+/* Size in words; USBD_CDC_HandleTypeDef is the only allocation (44 bytes) */
+#define MAX_STATIC_ALLOC_SIZE     11
 /****************************************/
 /* #define for FS and HS identification */
 #define DEVICE_FS		0
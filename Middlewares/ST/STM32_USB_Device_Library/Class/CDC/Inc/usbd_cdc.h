@@ -52,6 +52,11 @@
 /* CDC Endpoints parameters: you can fine tune these values depending on the needed baudrates and performance. */
 #define CDC_DATA_HS_MAX_PACKET_SIZE        512  /* Endpoint IN & OUT Packet size */
 #define CDC_DATA_FS_MAX_PACKET_SIZE         64  /* Endpoint IN & OUT Packet size */
+
+/* Buffer for the data stage of class requests, may be reduced in usbd_conf.h */
+#ifndef CDC_REQUEST_DATA_SIZE
+#define CDC_REQUEST_DATA_SIZE               CDC_DATA_HS_MAX_PACKET_SIZE
+#endif
 #define CDC_CMD_PACKET_SIZE                  8  /* Control Endpoint Packet size */
 
 #define USB_CDC_CONFIG_DESC_SIZ                67
@@ -101,13 +106,14 @@ typedef struct _USBD_CDC_Itf
   int8_t (* DeInit)        (void);
   int8_t (* Control)       (uint8_t, uint8_t * , uint16_t);
   int8_t (* Receive)       (uint8_t *, uint32_t *);
+  int8_t (* TransmitCplt)  (uint8_t *, uint32_t *, uint8_t);
 
 }USBD_CDC_ItfTypeDef;
 
 
 typedef struct
 {
-  uint32_t data[CDC_DATA_HS_MAX_PACKET_SIZE/4];      /* Force 32bits alignment */
+  uint32_t data[CDC_REQUEST_DATA_SIZE/4];      /* Force 32bits alignment */
   uint8_t  CmdOpCode;
   uint8_t  CmdLength;
   uint8_t  *RxBuffer;
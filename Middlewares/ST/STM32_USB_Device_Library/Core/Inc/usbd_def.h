@@ -50,6 +50,11 @@
 #define NULL ((void *)0)
 #endif
 
+/* Number of endpoint numbers, whose state the device handle keeps */
+#ifndef USBD_MAX_NUM_ENDPOINTS
+#define USBD_MAX_NUM_ENDPOINTS                          15
+#endif
+
 
 #define  USB_LEN_DEV_QUALIFIER_DESC                     0x0A
 #define  USB_LEN_DEV_DESC                               0x12
@@ -222,8 +227,8 @@ typedef struct _USBD_HandleTypeDef
   uint32_t                dev_default_config;
   uint32_t                dev_config_status; 
   USBD_SpeedTypeDef       dev_speed; 
-  USBD_EndpointTypeDef    ep_in[15];
-  USBD_EndpointTypeDef    ep_out[15];  
+  USBD_EndpointTypeDef    ep_in[USBD_MAX_NUM_ENDPOINTS];
+  USBD_EndpointTypeDef    ep_out[USBD_MAX_NUM_ENDPOINTS];  
   uint32_t                ep0_state;  
   uint32_t                ep0_data_len;     
   uint8_t                 dev_state;
@@ -286,6 +286,11 @@ USBD_StatusTypeDef  USBD_StdEPReq (USBD_HandleTypeDef *pdev , USBD_SetupReqTyped
       break;	
       
     case USBD_STATE_CONFIGURED:
+      if ((ep_addr & 0x7F) >= USBD_MAX_NUM_ENDPOINTS)
+      {
+        USBD_CtlError(pdev , req);
+        break;
+      }
       pep = ((ep_addr & 0x80) == 0x80) ? &pdev->ep_in[ep_addr & 0x7F]:\
                                          &pdev->ep_out[ep_addr & 0x7F];
       if(USBD_LL_IsStallEP(pdev, ep_addr))
@@ -334,15 +339,14 @@ static void USBD_GetDescriptor(USBD_HandleTypeDef *pdev ,
     break;
     
   case USB_DESC_TYPE_CONFIGURATION:     
+    /* The class descriptors hold their bDescriptorType and may live in flash, so they are not patched */
     if(pdev->dev_speed == USBD_SPEED_HIGH )   
     {
       pbuf   = (uint8_t *)pdev->pClass->GetHSConfigDescriptor(&len);
-      pbuf[1] = USB_DESC_TYPE_CONFIGURATION;
     }
     else
     {
       pbuf   = (uint8_t *)pdev->pClass->GetFSConfigDescriptor(&len);
-      pbuf[1] = USB_DESC_TYPE_CONFIGURATION;
     }
     break;
     
@@ -400,7 +404,6 @@ static void USBD_GetDescriptor(USBD_HandleTypeDef *pdev ,
     if(pdev->dev_speed == USBD_SPEED_HIGH  )   
     {
       pbuf   = (uint8_t *)pdev->pClass->GetOtherSpeedConfigDescriptor(&len);
-      pbuf[1] = USB_DESC_TYPE_OTHER_SPEED_CONFIGURATION;
       break; 
     }
     else
@@ -0,0 +1,263 @@
+/**
+ * @file
+ * @brief Binary host protocol with COBS framing
+ */
+
+#include "binary.h"
+#include "platform.h"
+#include "config.h"
+#include <error.h>
+
+
+/**
+ * Maximum length of a decoded record from the PC: kind byte and SLCAN command
+ */
+#define BINARY_RECORD_MAX_LENGTH    (1 + SLCAN_COMMAND_MAX_LENGTH)
+
+/*
+ * Record being received
+ */
+static uint8_t record[BINARY_RECORD_MAX_LENGTH];
+static uint8_t record_length = 0;
+/** Remaining bytes of the current COBS block */
+static uint8_t block_remaining = 0;
+/** Whether the current COBS block is followed by a zero byte */
+static bool block_zero = false;
+/** Set, when a record exceeded the buffer and must be skipped up to its delimiter */
+static bool record_overflow = false;
+
+/*
+ * Compression state, mirrored by the PC
+ */
+#define BINARY_ID_NONE      0xFFFFFFFF
+/** Identifiers by slot, with bit 29 set for extended identifiers */
+static uint32_t id_table[BINARY_ID_TABLE_LENGTH];
+static uint32_t previous_timestamp;
+
+
+/**
+ * Encodes a record with COBS and appends the delimiter
+ *
+ * Records are shorter than 254 bytes, so every block fits into one code byte.
+ *
+ * @return Length of the encoded record including the delimiter
+ */
+static uint8_t binary_encode(const uint8_t* src, uint8_t len, uint8_t* dst)
+{
+    uint8_t code_index = 0;
+    uint8_t o = 1;
+
+    for (uint8_t i=0; i<len; i++) {
+        if (src[i] == 0) {
+            dst[code_index] = o - code_index;
+            code_index = o++;
+        } else {
+            dst[o++] = src[i];
+        }
+    }
+    dst[code_index] = o - code_index;
+    dst[o++] = BINARY_DELIMITER;
+    return o;
+}
+
+
+uint8_t binary_encode_frame(const can_frame_t* frame, uint8_t* buf)
+{
+    uint8_t raw[17];
+    uint8_t i = 0;
+
+    raw[i++] = (frame->flags & CAN_FRAME_FLAG_EXTENDED ? BINARY_KIND_EXTENDED : 0)
+             | (frame->flags & CAN_FRAME_FLAG_REMOTE ? BINARY_KIND_REMOTE : 0)
+             | frame->dlc;
+
+    raw[i++] = frame->id;
+    raw[i++] = frame->id >> 8;
+    if (frame->flags & CAN_FRAME_FLAG_EXTENDED) {
+        raw[i++] = frame->id >> 16;
+        raw[i++] = frame->id >> 24;
+    }
+
+    for (uint8_t j=0; j<4; j++)
+        raw[i++] = frame->timestamp >> (8*j);
+
+    if (!(frame->flags & CAN_FRAME_FLAG_REMOTE))
+        for (uint8_t j=0; j<frame->dlc; j++)
+            raw[i++] = frame->data[j];
+
+    return binary_encode(raw, i, buf);
+}
+
+
+/**
+ * Returns the table slot of an identifier
+ *
+ * Each identifier has a fixed slot, so looking it up takes constant time.
+ */
+static inline uint8_t binary_id_slot(uint32_t key)
+{
+    return (key ^ (key >> 6) ^ (key >> 12) ^ (key >> 18) ^ (key >> 24)) & (BINARY_ID_TABLE_LENGTH - 1);
+}
+
+
+uint8_t binary_encode_compressed_frame(const can_frame_t* frame, uint8_t* buf)
+{
+    uint8_t raw[19];
+    uint8_t i = 0;
+    bool extended = (frame->flags & CAN_FRAME_FLAG_EXTENDED);
+
+    raw[i++] = BINARY_KIND_RESERVED
+             | (extended ? BINARY_KIND_EXTENDED : 0)
+             | (frame->flags & CAN_FRAME_FLAG_REMOTE ? BINARY_KIND_REMOTE : 0)
+             | frame->dlc;
+
+    uint32_t key = frame->id | (extended ? (1UL << 29) : 0);
+    uint8_t slot = binary_id_slot(key);
+    if (id_table[slot] == key) {
+        raw[i++] = slot;
+    } else {
+        // Replace the identifier in the slot
+        id_table[slot] = key;
+        raw[i++] = 0x80 | slot;
+        raw[i++] = frame->id;
+        raw[i++] = frame->id >> 8;
+        if (extended) {
+            raw[i++] = frame->id >> 16;
+            raw[i++] = frame->id >> 24;
+        }
+    }
+
+    // Zigzag: frames held back by the filter policies may be older than the previous frame
+    int32_t difference = frame->timestamp - previous_timestamp;
+    uint32_t delta = ((uint32_t) difference << 1) ^ (uint32_t) (difference >> 31);
+    previous_timestamp = frame->timestamp;
+    while (delta >= 0x80) {
+        raw[i++] = 0x80 | (delta & 0x7F);
+        delta >>= 7;
+    }
+    raw[i++] = delta;
+
+    if (!(frame->flags & CAN_FRAME_FLAG_REMOTE))
+        for (uint8_t j=0; j<frame->dlc; j++)
+            raw[i++] = frame->data[j];
+
+    return binary_encode(raw, i, buf);
+}
+
+
+void binary_reset_compression(void)
+{
+    for (uint8_t i=0; i<BINARY_ID_TABLE_LENGTH; i++)
+        id_table[i] = BINARY_ID_NONE;
+    previous_timestamp = 0;
+}
+
+
+uint8_t binary_encode_text(const uint8_t* text, uint8_t len, uint8_t* buf)
+{
+    uint8_t raw[1 + SLCAN_MTU];
+
+    raw[0] = BINARY_KIND_TEXT;
+    for (uint8_t i=0; i<len; i++)
+        raw[1 + i] = text[i];
+
+    return binary_encode(raw, 1 + len, buf);
+}
+
+
+/**
+ * Converts a frame record to a frame and queues it for transmission
+ */
+static int8_t binary_parse_frame(const uint8_t* buf, uint8_t len)
+{
+    can_frame_t frame;
+    uint8_t kind = buf[0];
+    uint8_t id_length = (kind & BINARY_KIND_EXTENDED) ? 4 : 2;
+    uint8_t i = 1;
+
+    frame.dlc = kind & BINARY_KIND_DLC;
+    frame.flags = ((kind & BINARY_KIND_EXTENDED) ? CAN_FRAME_FLAG_EXTENDED : 0)
+                | ((kind & BINARY_KIND_REMOTE) ? CAN_FRAME_FLAG_REMOTE : 0);
+    frame.timestamp = 0;
+
+    if (frame.dlc > 8)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+    if (len != 1 + id_length + ((kind & BINARY_KIND_REMOTE) ? 0 : frame.dlc))
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    frame.id = 0;
+    for (uint8_t j=0; j<id_length; j++)
+        frame.id |= (uint32_t) buf[i++] << (8*j);
+    if (frame.id > ((kind & BINARY_KIND_EXTENDED) ? 0x1FFFFFFF : 0x7FF))
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    for (uint8_t j=0; j<8; j++)
+        frame.data[j] = (j < frame.dlc && i < len) ? buf[i++] : 0;
+
+    if (!can_send(&frame))
+        return ERROR_TX_FIFO_OVERRUN;
+    return SUCCESS;
+}
+
+
+/**
+ * Executes a completely received record
+ */
+static int8_t binary_parse_record(uint8_t* buf, uint8_t len)
+{
+    if (buf[0] == BINARY_KIND_TEXT) {
+        // The command must be complete, including its terminator
+        if (len < 2 || buf[len - 1] != SLCAN_COMMAND_TERMINATOR)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return slcan_parse_command(&buf[1], len - 1);
+    }
+
+    if (buf[0] & (BINARY_KIND_TEXT | BINARY_KIND_RESERVED))
+        return ERROR_SLCAN_COMMAND_NOT_RECOGNIZED;
+
+    return binary_parse_frame(buf, len);
+}
+
+
+void binary_reset(void)
+{
+    record_length = 0;
+    block_remaining = 0;
+    block_zero = false;
+    record_overflow = false;
+}
+
+
+void binary_receive(uint8_t byte)
+{
+    if (byte == BINARY_DELIMITER) {
+        // Execute the record, unless it was truncated or did not fit into the buffer
+        if (!record_overflow && block_remaining == 0 && record_length > 0)
+            binary_parse_record(record, record_length);
+        binary_reset();
+        return;
+    }
+
+    if (record_overflow)
+        return;
+
+    if (block_remaining == 0) {
+        // COBS code byte: the previous block was followed by a zero byte, unless it was a full block.
+        if (block_zero) {
+            if (record_length >= BINARY_RECORD_MAX_LENGTH) {
+                record_overflow = true;
+                return;
+            }
+            record[record_length++] = 0;
+        }
+        block_remaining = byte - 1;
+        block_zero = (byte != 0xFF);
+        return;
+    }
+
+    if (record_length >= BINARY_RECORD_MAX_LENGTH) {
+        record_overflow = true;
+        return;
+    }
+    record[record_length++] = byte;
+    block_remaining--;
+}
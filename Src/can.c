@@ -8,10 +8,13 @@
 #include "config.h"
 #include "slcan.h"
 #include "led.h"
-#include "fifo.h"
-
-#include "usbd_cdc_if.h"
-#include "usart.h"
+#include "frame_fifo.h"
+#include "frame_heap.h"
+#include "cyclic.h"
+#include "playback.h"
+#include "generator.h"
+#include "timebase.h"
+#include "filter.h"
 
 
 /**
@@ -30,32 +33,54 @@ static uint32_t prescaler;
 enum can_bus_state bus_state;
 
 /**
- * Reception buffer for one frame
+ * Buffer for incoming CAN frames
  */
-CanRxMsgTypeDef can_rx_frame;
+can_frame_t can_rx_buffer[CAN_RX_QUEUE_LENGTH];
+frame_fifo_t can_rx_fifo;
 
 /**
- * Transmission buffer for one frame
+ * Buffer for outgoing CAN frames,
+ * organized either as FIFO or as priority queue (see can_set_tx_priority_mode)
  */
-CanTxMsgTypeDef can_tx_frame;
+can_frame_t can_tx_buffer[CAN_TX_QUEUE_LENGTH];
+frame_fifo_t can_tx_fifo;
+frame_heap_t can_tx_heap;
 
 /**
- * Buffer for incoming CAN frames
+ * Whether outgoing frames are transmitted by identifier priority instead of in queue order
+ */
+static bool tx_priority_mode = false;
+
+/**
+ * Priority mode: Arbitration keys and sequence numbers of the frames in the transmit mailboxes
+ */
+static uint32_t tx_mailbox_key[3];
+static uint16_t tx_mailbox_sequence[3];
+
+/**
+ * Priority mode: Mailboxes, whose transmission was aborted
+ * in favor of a higher priority frame, as TSR RQCPx bits
+ */
+static uint32_t tx_preempted;
+
+/**
+ * Mailboxes loaded by @ref can_transmit_immediately, as bits 0-2;
+ * their frames are not in the queue and must not be preempted
  */
-uint8_t can_rx_buffer[CAN_RX_BUFFER_SIZE];
-fifo_t can_rx_fifo;
+static uint8_t tx_mailbox_immediate;
 
 /**
- * Buffer for outgoing SLCAN frames
+ * Transmission statistics, updated by the CAN interrupt
  */
-uint8_t can_tx_buffer[CAN_TX_BUFFER_SIZE];
-fifo_t can_tx_fifo;
+static volatile can_tx_statistics_t tx_statistics;
 
 
 void can_init(void) {
     // Default speed: 1 Mbps
     hcan.Instance = CAN_PERIPHERAL;
     prescaler = CAN_PRESCALER_1000K;
+    // Default overrun policy: Keep the frames already in the hardware FIFO, discard new ones
+    hcan.Init.RFLM = ENABLE;
     // Reset bxCAN peripheral
     can_disable();
 }
@@ -100,73 +125,302 @@ void HAL_CAN_MspDeInit(CAN_HandleTypeDef* hcan)
 }
 
 
-void HAL_CAN_RxCpltCallback(CAN_HandleTypeDef* hcan)
+/**
+ * Converts the register contents of a reception or transmit mailbox to a frame
+ *
+ * RIR/TIR resp. RDTR/TDTR have the same layout regarding identifier, type and DLC.
+ */
+static inline void can_unpack_mailbox(uint32_t ir, uint32_t dtr, uint32_t dlr, uint32_t dhr, can_frame_t* frame)
 {
-    // Convert frame to SLCAN string
-    uint8_t buffer[SLCAN_MTU];
-    uint16_t length = slcan_parse_frame(hcan->pRxMsg, buffer);
+    if (ir & CAN_RI0R_IDE) {
+        frame->id = ir >> 3;
+        frame->flags = CAN_FRAME_FLAG_EXTENDED;
+    } else {
+        frame->id = ir >> 21;
+        frame->flags = 0;
+    }
+    if (ir & CAN_RI0R_RTR)
+        frame->flags |= CAN_FRAME_FLAG_REMOTE;
+
+    frame->dlc = dtr & CAN_RDT0R_DLC;
+    if (frame->dlc > 8)
+        frame->dlc = 8;
+
+    frame->data[0] = dlr;
+    frame->data[1] = dlr >> 8;
+    frame->data[2] = dlr >> 16;
+    frame->data[3] = dlr >> 24;
+    frame->data[4] = dhr;
+    frame->data[5] = dhr >> 8;
+    frame->data[6] = dhr >> 16;
+    frame->data[7] = dhr >> 24;
+}
+
 
-    // Append SLCAN string to buffer
-    fifo_push(&can_rx_fifo, buffer, length);
+/**
+ * Copies all frames pending in one of the two bxCAN reception FIFOs
+ * to the reception queue and releases the hardware mailboxes
+ *
+ * The mailbox registers are read directly instead of via the HAL,
+ * which would process only one frame per interrupt and
+ * disable the FIFO message pending interrupt afterwards.
+ *
+ * @param fifo_number   CAN_FIFO0 or CAN_FIFO1
+ * @param timestamp     Time of reception to assign to the frames
+ */
+static inline void can_receive_fifo(uint8_t fifo_number, uint32_t timestamp)
+{
+    CAN_FIFOMailBox_TypeDef* mailbox = &CAN_PERIPHERAL->sFIFOMailBox[fifo_number];
+    // RF0R and RF1R are adjacent and have identical bit layouts
+    __IO uint32_t* rfr = &CAN_PERIPHERAL->RF0R + fifo_number;
+    can_frame_t frame;
 
-    // Receive more frames
-    HAL_CAN_Receive_IT(hcan, CAN_FIFO0);
+    while ((*rfr & CAN_RF0R_FMP0) != 0)
+    {
+        uint32_t rir = mailbox->RIR;
+        uint32_t rdtr = mailbox->RDTR;
+        uint32_t rdlr = mailbox->RDLR;
+        uint32_t rdhr = mailbox->RDHR;
+
+        // Release the output mailbox; writing zeros to the other bits has no effect
+        *rfr = CAN_RF0R_RFOM0;
+
+        can_unpack_mailbox(rir, rdtr, rdlr, rdhr, &frame);
+        frame.timestamp = timestamp;
+
+        if (!filter_software_accept(&frame)
+         || !filter_policy_accept(fifo_number, (rdtr & CAN_RDT0R_FMI) >> 8, &frame))
+            continue;
+
+        can_queue_received(&frame);
+    }
 }
 
 
-void HAL_CAN_TxCpltCallback(CAN_HandleTypeDef *hcan)
+bool can_queue_received(const can_frame_t* frame)
 {
-    // Remove last transmitted frame from buffer
-//    fifo_drop_oldest_entry(&can_tx_fifo);
+    if (bus_state != ON_BUS)
+        return false;
+
+    if (!frame_fifo_push(&can_rx_fifo, frame)) {
+        // Reception queue overrun: frame lost
+        led_on(LED_ERROR);
+        return false;
+    }
+    return true;
 }
 
 
-void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
+/**
+ * Copies a frame to a transmit mailbox and requests its transmission
+ *
+ * @param index     Number of an empty transmit mailbox (0-2)
+ * @param frame     Frame to transmit
+ */
+static inline void can_write_transmit_mailbox(uint8_t index, const can_frame_t* frame)
 {
-    // TODO: Resolve errors
-    led_on(LED_ERROR);
+    CAN_TxMailBox_TypeDef* mailbox = &CAN_PERIPHERAL->sTxMailBox[index];
+    uint32_t tir;
 
-    // Reset bxCAN
-    hcan->Instance->MCR |= CAN_MCR_RESET | CAN_MCR_SLEEP;
-    // Wait until sleep mode is reached
-    while ((hcan->Instance->MSR & CAN_MSR_SLAK) == 0);
-    // Request initialization
-    hcan->Instance->MCR &= ~(CAN_MCR_INRQ | CAN_MCR_SLEEP);
-    // Wait for confirmation of switch to normal mode
-    while ((hcan->Instance->MSR & CAN_MSR_INAK) > 0);
+    if (frame->flags & CAN_FRAME_FLAG_EXTENDED)
+        tir = (frame->id << 3) | CAN_TI0R_IDE;
+    else
+        tir = frame->id << 21;
+    if (frame->flags & CAN_FRAME_FLAG_REMOTE)
+        tir |= CAN_TI0R_RTR;
+
+    mailbox->TDTR = frame->dlc & CAN_TDT0R_DLC;
+    mailbox->TDLR = ((uint32_t) frame->data[3] << 24)
+                  | ((uint32_t) frame->data[2] << 16)
+                  | ((uint32_t) frame->data[1] << 8)
+                  | frame->data[0];
+    mailbox->TDHR = ((uint32_t) frame->data[7] << 24)
+                  | ((uint32_t) frame->data[6] << 16)
+                  | ((uint32_t) frame->data[5] << 8)
+                  | frame->data[4];
+
+    // Setting TXRQ last hands the mailbox over to the hardware
+    mailbox->TIR = tir | CAN_TI0R_TXRQ;
+}
 
-    /* Enable Error warning Interrupt */
-    __HAL_CAN_DISABLE_IT(hcan, CAN_IT_EWG);
 
-    /* Enable Error passive Interrupt */
-    __HAL_CAN_DISABLE_IT(hcan, CAN_IT_EPV);
+/**
+ * Fills all empty transmit mailboxes with frames from the transmission queue
+ *
+ * Only ever called from the CAN interrupt, which is thereby
+ * the one and only consumer of the transmission queue.
+ * Since TXFP is set, the mailboxes are transmitted in the order they were loaded.
+ */
+static inline void can_load_transmit_mailboxes(void)
+{
+    can_frame_t* frame;
 
-    /* Enable Bus-off Interrupt */
-    __HAL_CAN_DISABLE_IT(hcan, CAN_IT_BOF);
+    // Frames were validated when they were queued, so they can be copied to the mailboxes right away.
+    while ((CAN_PERIPHERAL->TSR & CAN_TSR_TME) != 0
+        && (frame = frame_fifo_peek(&can_tx_fifo)) != NULL)
+    {
+        // CODE contains the number of the next empty mailbox.
+        uint8_t index = (CAN_PERIPHERAL->TSR & CAN_TSR_CODE) >> 24;
+        tx_mailbox_immediate &= ~(1 << index);
+        can_write_transmit_mailbox(index, frame);
+        frame_fifo_commit_pop(&can_tx_fifo);
+    }
+}
 
-    /* Enable Last error code Interrupt */
-    __HAL_CAN_DISABLE_IT(hcan, CAN_IT_LEC);
 
-    /* Enable Error Interrupt */
-    __HAL_CAN_DISABLE_IT(hcan, CAN_IT_ERR);
+/**
+ * Priority mode: Returns aborted frames to the priority queue
+ *
+ * @param completed     TSR RQCPx bits of the mailboxes, which just completed
+ * @param tsr           TSR content before the completion was acknowledged
+ */
+static inline void can_requeue_preempted_frames(uint32_t completed, uint32_t tsr)
+{
+    const uint32_t request_completed_flag[3] = {CAN_TSR_RQCP0, CAN_TSR_RQCP1, CAN_TSR_RQCP2};
+    const uint32_t transmission_ok_flag[3] = {CAN_TSR_TXOK0, CAN_TSR_TXOK1, CAN_TSR_TXOK2};
+    can_frame_t frame;
+
+    for (uint8_t i=0; i<3; i++)
+    {
+        if (!(completed & tx_preempted & request_completed_flag[i]))
+            continue;
+        tx_preempted &= ~request_completed_flag[i];
+
+        if (tsr & transmission_ok_flag[i])
+            // The frame was already being transmitted, when the abort was requested.
+            continue;
+
+        // The mailbox registers still contain the aborted frame.
+        CAN_TxMailBox_TypeDef* mailbox = &CAN_PERIPHERAL->sTxMailBox[i];
+        can_unpack_mailbox(mailbox->TIR, mailbox->TDTR, mailbox->TDLR, mailbox->TDHR, &frame);
+        frame.timestamp = tx_mailbox_sequence[i];
+        // The preemption is only requested, while the queue has a free slot for this.
+        frame_heap_requeue(&can_tx_heap, &frame);
+    }
 }
 
 
-inline void can_enable_interrupt_switches() {
-    /*
-     * FMP0: FIFO0 message pending interrupt switch
-     * TME: Transmit mailbox empty
-     */
-    __HAL_CAN_ENABLE_IT(&hcan, CAN_IT_FMP0);
+/**
+ * Priority mode: Keeps the highest priority frames in the transmit mailboxes
+ *
+ * With TXFP cleared, the hardware itself transmits the mailbox
+ * with the lowest identifier first. If a frame with higher priority
+ * than any mailbox content is queued while all mailboxes are occupied,
+ * the lowest priority mailbox is aborted and its frame returned to the queue.
+ *
+ * Frames with the same identifier are never loaded into two mailboxes at once,
+ * as the hardware would then transmit them in mailbox order instead of queue order.
+ *
+ * Mailboxes loaded by @ref can_transmit_immediately are never preempted:
+ * Their frames are scheduled by the firmware and would otherwise
+ * be transmitted again later, as if queued by the host.
+ */
+static inline void can_load_transmit_mailboxes_by_priority(void)
+{
+    const uint32_t mailbox_empty_flag[3] = {CAN_TSR_TME0, CAN_TSR_TME1, CAN_TSR_TME2};
+    can_frame_t* frame;
+    uint32_t key;
+
+    while ((frame = frame_heap_peek(&can_tx_heap)) != NULL)
+    {
+        uint32_t tsr = CAN_PERIPHERAL->TSR;
+        key = can_arbitration_key(frame);
+
+        // Find the preemptible occupied mailbox with the lowest priority
+        uint8_t lowest = 3;
+        for (uint8_t i=0; i<3; i++)
+        {
+            if (tsr & mailbox_empty_flag[i])
+                continue;
+            if (tx_mailbox_key[i] == key)
+                // Wait for the frame with the same identifier to be transmitted first
+                return;
+            if (tx_mailbox_immediate & (1 << i))
+                continue;
+            if (lowest == 3 || tx_mailbox_key[i] > tx_mailbox_key[lowest])
+                lowest = i;
+        }
+
+        if ((tsr & CAN_TSR_TME) == 0)
+        {
+            // All mailboxes occupied: Preempt the lowest priority one, unless an abort is already pending
+            // or the queue has no room to take the aborted frame back.
+            if (!tx_preempted && lowest != 3 && key < tx_mailbox_key[lowest]
+                && frame_heap_get_length(&can_tx_heap) < CAN_TX_QUEUE_LENGTH)
+            {
+                tx_preempted = CAN_TSR_RQCP0 << (lowest * 8);
+                CAN_PERIPHERAL->TSR = CAN_TSR_ABRQ0 << (lowest * 8);
+            }
+            return;
+        }
+
+        // CODE contains the number of the next empty mailbox.
+        uint8_t index = (tsr & CAN_TSR_CODE) >> 24;
+        tx_mailbox_key[index] = key;
+        tx_mailbox_sequence[index] = frame->timestamp;
+        tx_mailbox_immediate &= ~(1 << index);
+        can_write_transmit_mailbox(index, frame);
+        frame_heap_remove_top(&can_tx_heap);
+    }
 }
 
 
 void CEC_CAN_IRQHandler()
 {
-    HAL_CAN_IRQHandler(&hcan);
+    /*
+     * Sample the timebase first thing, so that the timestamps
+     * only lag the end of frame by the interrupt latency.
+     * Frames, which have been waiting in a hardware FIFO meanwhile, get the same timestamp.
+     */
+    uint32_t now = now_us();
+
+    // Drain both hardware reception FIFOs
+    can_receive_fifo(CAN_FIFO0, now);
+    can_receive_fifo(CAN_FIFO1, now);
+
+    // Transmission requests completed: successfully, aborted or failed
+    uint32_t tsr = CAN_PERIPHERAL->TSR;
+    uint32_t completed = tsr & (CAN_TSR_RQCP0 | CAN_TSR_RQCP1 | CAN_TSR_RQCP2);
+    if (completed)
+    {
+        // Acknowledge; this also clears the TXOK, ALST and TERR bits of the respective mailboxes.
+        CAN_PERIPHERAL->TSR = completed;
+        if (tsr & (CAN_TSR_TXOK0 | CAN_TSR_TXOK1 | CAN_TSR_TXOK2))
+            led_on(LED_ACTIVITY);
 
-    // Re-enable interrupts after the HAL IRQ handler disables them
-    can_enable_interrupt_switches();
+        // The flags of mailbox 1 and 2 are located 8 resp. 16 bits above those of mailbox 0.
+        for (uint8_t shift=0; shift<=16; shift+=8)
+        {
+            uint32_t flags = tsr >> shift;
+            if (!(flags & CAN_TSR_RQCP0))
+                continue;
+            if (flags & CAN_TSR_TXOK0)
+                tx_statistics.transmitted++;
+            if (flags & CAN_TSR_ALST0)
+                tx_statistics.arbitration_lost++;
+            if (flags & CAN_TSR_TERR0)
+                tx_statistics.errors++;
+        }
+        if (tx_preempted)
+            can_requeue_preempted_frames(completed, tsr);
+    }
+
+    // Refill empty transmit mailboxes; this is also reached, when the main loop or can_send set the interrupt pending.
+    // Cyclic, played back and generated frames, which came due while the mailboxes were occupied, go first.
+    cyclic_load_pending();
+    playback_load_pending();
+    generator_load_pending();
+    if (tx_priority_mode)
+        can_load_transmit_mailboxes_by_priority();
+    else
+        can_load_transmit_mailboxes();
+
+    // Error passive or bus-off state was entered
+    if (CAN_PERIPHERAL->MSR & CAN_MSR_ERRI)
+    {
+        CAN_PERIPHERAL->MSR = CAN_MSR_ERRI;
+        led_on(LED_ERROR);
+    }
 }
 
 
@@ -176,10 +430,13 @@ void can_enable(void) {
     }
 
     // Clear FIFO buffers
-    fifo_init(&can_rx_fifo, can_rx_buffer, CAN_RX_BUFFER_SIZE);
-    fifo_init(&can_tx_fifo, can_tx_buffer, CAN_TX_BUFFER_SIZE);
+    frame_fifo_init(&can_rx_fifo, can_rx_buffer, CAN_RX_QUEUE_LENGTH);
+    frame_fifo_init(&can_tx_fifo, can_tx_buffer, CAN_TX_QUEUE_LENGTH);
+    frame_heap_init(&can_tx_heap, can_tx_buffer, CAN_TX_QUEUE_LENGTH);
+    tx_preempted = 0;
+    tx_mailbox_immediate = 0;
 
-    hcan.pRxMsg = &can_rx_frame;
+    hcan.pRxMsg = 0;
     hcan.pTxMsg = 0;
 
     hcan.Init.Prescaler = prescaler;
@@ -191,8 +448,8 @@ void can_enable(void) {
     hcan.Init.ABOM = ENABLE;
     hcan.Init.AWUM = ENABLE;
     hcan.Init.NART = DISABLE;
-    hcan.Init.RFLM = ENABLE;
-    hcan.Init.TXFP = 1;
+    // Transmit mailboxes in request order, or by identifier in priority mode
+    hcan.Init.TXFP = tx_priority_mode ? 0 : 1;
     if (HAL_CAN_Init(&hcan) == HAL_OK)
     {
         led_on(LED_ACTIVITY);
@@ -204,14 +461,18 @@ void can_enable(void) {
     }
     bus_state = ON_BUS;
 
-    // No filtering: Receive all frames
-    can_set_filter(0, 0);
+    // Accept the identifiers set up with the filter manager, all frames by default
+    filter_apply();
 
-    // Enable interrupts
+    /*
+     * Enable interrupts:
+     * FMP0/FMP1: FIFO message pending; these stay enabled for as long as the bus is on.
+     * TME: Transmission request completed, i.e. a transmit mailbox became empty
+     * EPV/BOF: Error passive and bus-off state changes
+     */
+    __HAL_CAN_ENABLE_IT(&hcan, CAN_IT_FMP0 | CAN_IT_FMP1 | CAN_IT_TME | CAN_IT_EPV | CAN_IT_BOF | CAN_IT_ERR);
     HAL_NVIC_SetPriority(CEC_CAN_IRQn, IRQ_PRIORITY_CAN, 0);
     HAL_NVIC_EnableIRQ(CEC_CAN_IRQn);
-
-    HAL_CAN_Receive_IT(&hcan, CAN_FIFO0);
 }
 
 
@@ -219,6 +480,11 @@ void can_disable(void) {
     // Disable interrupts
     HAL_NVIC_DisableIRQ(CEC_CAN_IRQn);
 
+    // Scheduled transmissions end with the channel
+    cyclic_stop(CYCLIC_ALL_ENTRIES);
+    playback_stop();
+    generator_stop();
+
     // Reset bxCAN peripheral (set RESET bit to 1)
     hcan.Instance->MCR |= CAN_MCR_RESET;
     // Wait until sleep mode is reached
@@ -268,35 +534,163 @@ void can_set_bitrate(enum can_bitrate bitrate) {
 }
 
 
-void can_set_filter(uint32_t id, uint32_t mask) {
+void can_configure_filter_bank(uint8_t bank, enum can_filter_mode mode, uint32_t fr1, uint32_t fr2, uint8_t fifo)
+{
     CAN_FilterConfTypeDef filter;
-
-    // see page 825 of RM0091 for details on filters
-    // set the standard ID part
-    filter.FilterIdHigh = (id & 0x7FF) << 5;
-    // add the top 5 bits of the extended ID
-    filter.FilterIdHigh += (id >> 24) & 0xFFFF;
-    // set the low part to the remaining extended ID bits
-    filter.FilterIdLow = ((id & 0x1FFFF800) << 3);
-
-    // set the standard ID part
-    filter.FilterMaskIdHigh = (mask & 0x7FF) << 5;
-    // add the top 5 bits of the extended ID
-    filter.FilterMaskIdHigh += (mask >> 24) & 0xFFFF;
-    // set the low part to the remaining extended ID bits
-    filter.FilterMaskIdLow = ((mask & 0x1FFFF800) << 3);
-
-    filter.FilterMode = CAN_FILTERMODE_IDMASK;
-    filter.FilterScale = CAN_FILTERSCALE_32BIT;
-    filter.FilterNumber = 0;
-    filter.FilterFIFOAssignment = CAN_FIFO0;
+    bool scale16 = (mode == CAN_FILTER_MASK_16BIT || mode == CAN_FILTER_LIST_16BIT);
+
+    // The HAL composes the registers from the halves differently depending on the scale.
+    if (scale16) {
+        filter.FilterIdLow = fr1 & 0xFFFF;
+        filter.FilterMaskIdLow = fr1 >> 16;
+        filter.FilterIdHigh = fr2 & 0xFFFF;
+        filter.FilterMaskIdHigh = fr2 >> 16;
+    } else {
+        filter.FilterIdHigh = fr1 >> 16;
+        filter.FilterIdLow = fr1 & 0xFFFF;
+        filter.FilterMaskIdHigh = fr2 >> 16;
+        filter.FilterMaskIdLow = fr2 & 0xFFFF;
+    }
+    filter.FilterMode = (mode == CAN_FILTER_LIST_32BIT || mode == CAN_FILTER_LIST_16BIT)
+                        ? CAN_FILTERMODE_IDLIST : CAN_FILTERMODE_IDMASK;
+    filter.FilterScale = scale16 ? CAN_FILTERSCALE_16BIT : CAN_FILTERSCALE_32BIT;
+    filter.FilterNumber = bank;
+    filter.FilterFIFOAssignment = fifo;
     filter.BankNumber = 0;
-    filter.FilterActivation = ENABLE;
+    filter.FilterActivation = (mode != CAN_FILTER_DISABLED) ? ENABLE : DISABLE;
 
     HAL_CAN_ConfigFilter(&hcan, &filter);
 }
 
 
+void can_set_filter(uint32_t id, uint32_t mask) {
+    /*
+     * A frame is accepted, if (frame ID & mask) == (id & mask),
+     * where the 11 least significant bits of id and mask are applied to standard frames
+     * and all 29 bits are applied to extended frames.
+     *
+     * Accepted frames are spread across both reception FIFOs by the parity of their ID,
+     * giving the interrupt six instead of three hardware mailboxes of slack.
+     * Frames with the same ID always end up in the same FIFO,
+     * so the order of frames per ID is preserved.
+     * One bank per frame type and parity is required:
+     *
+     *  bank 0: standard, even ID -> FIFO0
+     *  bank 1: standard, odd ID  -> FIFO1
+     *  bank 2: extended, even ID -> FIFO0
+     *  bank 3: extended, odd ID  -> FIFO1
+     */
+    for (uint8_t bank=0; bank<4; bank++)
+    {
+        bool extended = (bank >= 2);
+        uint8_t parity = bank & 1;
+        uint8_t shift = extended ? CAN_FILTER_EXID_SHIFT : CAN_FILTER_STID_SHIFT;
+        uint32_t id_bits = extended ? (id & 0x1FFFFFFF) : (id & 0x7FF);
+        uint32_t mask_bits = extended ? (mask & 0x1FFFFFFF) : (mask & 0x7FF);
+
+        // If the filter itself already decides on the ID parity, one of the banks can never match.
+        bool enable = !((mask_bits & 1) && ((id_bits & 1) != parity));
+
+        id_bits = (id_bits & ~1) | parity;
+        mask_bits |= 1;
+
+        can_configure_filter_bank(
+                bank,
+                enable ? CAN_FILTER_MASK_32BIT : CAN_FILTER_DISABLED,
+                (id_bits << shift) | (extended ? CAN_FILTER_IDE : 0),
+                (mask_bits << shift) | CAN_FILTER_IDE,
+                parity ? CAN_FIFO1 : CAN_FIFO0);
+    }
+
+    // Banks possibly used by the filter manager
+    for (uint8_t bank=4; bank<FILTER_BANK_COUNT; bank++)
+        can_configure_filter_bank(bank, CAN_FILTER_DISABLED, 0, 0, CAN_FIFO0);
+}
+
+
+void can_set_rx_overrun_mode(uint8_t locked) {
+    hcan.Init.RFLM = locked ? ENABLE : DISABLE;
+
+    // Unlike the bit timing, this setting may also be changed while on bus.
+    if (bus_state == ON_BUS) {
+        if (locked) {
+            hcan.Instance->MCR |= CAN_MCR_RFLM;
+        } else {
+            hcan.Instance->MCR &= ~CAN_MCR_RFLM;
+        }
+    }
+}
+
+
+bool can_send(const can_frame_t* frame) {
+    if (!tx_priority_mode)
+        // The CAN interrupt picks the frame up, when the next mailbox becomes empty.
+        return frame_fifo_push(&can_tx_fifo, frame);
+
+    // The CAN interrupt modifies the heap as well.
+    HAL_NVIC_DisableIRQ(CEC_CAN_IRQn);
+    // Keep one slot free for a frame returned to the queue after preemption
+    bool queued = frame_heap_get_length(&can_tx_heap) < CAN_TX_QUEUE_LENGTH - 1;
+    if (queued)
+        frame_heap_push(&can_tx_heap, frame);
+    if (bus_state == ON_BUS) {
+        HAL_NVIC_EnableIRQ(CEC_CAN_IRQn);
+        // Let the interrupt decide, whether the frame should preempt a mailbox
+        if (queued)
+            HAL_NVIC_SetPendingIRQ(CEC_CAN_IRQn);
+    }
+    return queued;
+}
+
+
+bool can_transmit_immediately(const can_frame_t* frame) {
+    if (bus_state != ON_BUS || (CAN_PERIPHERAL->TSR & CAN_TSR_TME) == 0)
+        return false;
+
+    // CODE contains the number of the next empty mailbox.
+    uint8_t index = (CAN_PERIPHERAL->TSR & CAN_TSR_CODE) >> 24;
+    tx_mailbox_key[index] = can_arbitration_key(frame);
+    tx_mailbox_sequence[index] = 0;
+    tx_mailbox_immediate |= 1 << index;
+    can_write_transmit_mailbox(index, frame);
+    return true;
+}
+
+
+enum can_bus_state can_get_bus_state(void) {
+    return bus_state;
+}
+
+
+uint32_t can_get_bitrate(void) {
+    // Bit time = (1 + (TS1+1) + (TS2+1)) time quanta of (BRP+1) peripheral clock cycles
+    uint32_t btr = CAN_PERIPHERAL->BTR;
+    uint32_t prescaler = (btr & CAN_BTR_BRP) + 1;
+    uint32_t quanta = 3 + ((btr & CAN_BTR_TS1) >> 16) + ((btr & CAN_BTR_TS2) >> 20);
+    return HAL_RCC_GetPCLK1Freq() / (prescaler * quanta);
+}
+
+
+void can_get_tx_statistics(can_tx_statistics_t* statistics) {
+    // Block the interrupt, so the counters are consistent with each other
+    HAL_NVIC_DisableIRQ(CEC_CAN_IRQn);
+    statistics->transmitted = tx_statistics.transmitted;
+    statistics->arbitration_lost = tx_statistics.arbitration_lost;
+    statistics->errors = tx_statistics.errors;
+    if (bus_state == ON_BUS)
+        HAL_NVIC_EnableIRQ(CEC_CAN_IRQn);
+}
+
+
+void can_set_tx_priority_mode(uint8_t enabled) {
+    if (bus_state == ON_BUS) {
+        // cannot change the transmission order while on bus
+        return;
+    }
+    tx_priority_mode = enabled;
+}
+
+
 void can_set_silent(uint8_t silent) {
     if (bus_state == ON_BUS) {
         // cannot set silent mode while on bus
@@ -313,7 +707,7 @@ void can_set_silent(uint8_t silent) {
 void can_check_transmit_mailboxes()
 {
     static bool timeout_enabled[3] = {false, false, false};
-    static uint32_t timeout_start_ms[3];
+    static uint32_t timeout_start[3];
     const uint32_t error_flag[3] = {CAN_TSR_TERR0, CAN_TSR_TERR1, CAN_TSR_TERR2};
     const uint32_t arbitration_lost_flag[3] = {CAN_TSR_ALST0, CAN_TSR_ALST1, CAN_TSR_ALST2};
     const uint32_t abort_transmission_switch[3] = {CAN_TSR_ABRQ0, CAN_TSR_ABRQ1, CAN_TSR_ABRQ2};
@@ -325,19 +719,20 @@ void can_check_transmit_mailboxes()
         {
             if (timeout_enabled[i])
             {
-                if (HAL_GetTick() - timeout_start_ms[i] > CAN_TX_TIMEOUT)
+                if (now_us() - timeout_start[i] > CAN_TX_TIMEOUT)
                 {
                     // Abort transmission
                     timeout_enabled[i] = false;
-                    hcan.Instance->TSR |= abort_transmission_switch[i];
-                    hcan.Instance->TSR &= ~error_flag[i];
+                    // TSR flags are cleared by writing 1, so only the abort request must be written here.
+                    // Aborting completes the request, the interrupt then clears the flags and refills the mailbox.
+                    hcan.Instance->TSR = abort_transmission_switch[i];
                     led_on(LED_ERROR);
                 }
             }
             else
             {
                 // Enable timeout for this mailbox
-                timeout_start_ms[i] = HAL_GetTick();
+                timeout_start[i] = now_us();
                 timeout_enabled[i] = true;
             }
         }
@@ -347,89 +742,41 @@ void can_check_transmit_mailboxes()
 
 void can_process_rx() {
 
-    uint8_t buffer[SLCAN_MTU];
-    uint16_t length;
+    can_frame_t* frame;
 
-    enter_critical();
-    if (fifo_has_slcan_command(&can_rx_fifo, &length)) {
+    // The reception queue is lock-free, no need to block the CAN interrupt.
+    // Frames are only removed from the queue, once the interface to the PC has accepted them.
+    while ((frame = frame_fifo_peek(&can_rx_fifo)) != NULL) {
 
-        // Retrieve oldest SLCAN-encoded frame from reception buffer
-        if (fifo_pop(&can_rx_fifo, buffer, length))
-        {
-            exit_critical();
-        }
-        else
-        {
-            exit_critical();
-            return;
-        }
+        // Transmit oldest received frame to PC
+        if (!slcan_output_frame(frame))
+            // Retry later
+            break;
 
-        // Transmit SLCAN string to PC
-        // via USB
-        #ifdef PC_INTERFACE_USB
-        uint8_t result = CDC_Transmit_FS(buffer, length);
-        if (result == USBD_OK) {
-            led_on(LED_ACTIVITY);
-        } else {
-            led_on(LED_ERROR);
-        }
-        #endif
-        #ifdef PC_INTERFACE_UART
-        _write(0, (char*) buffer, length);
-        #endif
-    }
-    else
-    {
-        exit_critical();
+        frame_fifo_commit_pop(&can_rx_fifo);
+        led_on(LED_ACTIVITY);
     }
 }
 
 
 inline bool can_transmitter_is_ready() {
-    // TODO: Implement using reference manual and registers...
-    return (bus_state == ON_BUS) && ((hcan.Instance->TSR & CAN_TSR_TME) > 0);
+    // At least one of the three transmit mailboxes is empty
+    return (bus_state == ON_BUS) && ((hcan.Instance->TSR & CAN_TSR_TME) != 0);
 }
 
 
 void can_process_tx() {
-
-    uint8_t buffer[SLCAN_MTU];
-    uint16_t length;
-
-    if (can_transmitter_is_ready())
-    {
-        enter_critical();
-        if (fifo_has_slcan_command(&can_tx_fifo, &length)) {
-
-            // Retrieve the oldest frame from the transmission buffer
-            if (fifo_pop(&can_tx_fifo, buffer, length))
-            {
-                exit_critical();
-            }
-            else
-            {
-                exit_critical();
-                return;
-            }
-
-            // Convert SLCAN transmit command to CAN frame
-            hcan.pTxMsg = &can_tx_frame;
-            if (!slcan_parse_transmit_command(buffer, length, &can_tx_frame))
-                return;
-
-            // Transmit frame to CAN bus
-            HAL_StatusTypeDef result = HAL_CAN_Transmit(&hcan, 300);
-            if (result == HAL_OK) {
-                led_on(LED_ACTIVITY);
-            } else {
-                led_on(LED_ERROR);
-            }
-        }
-        else
-        {
-            exit_critical();
-        }
-    }
+    /*
+     * Frames are loaded into the mailboxes exclusively by the CAN interrupt,
+     * which refills them whenever a transmission completes.
+     * Only if the mailboxes ran empty meanwhile, the interrupt needs to be triggered from here.
+     * This never blocks, regardless of how long arbitration or retransmissions take.
+     */
+    bool pending = tx_priority_mode
+                    ? !frame_heap_is_empty(&can_tx_heap)
+                    : !frame_fifo_is_empty(&can_tx_fifo);
+    if (can_transmitter_is_ready() && pending)
+        HAL_NVIC_SetPendingIRQ(CEC_CAN_IRQn);
 }
 
 
@@ -441,6 +788,4 @@ void can_process() {
 
     // Make sure, the transmitter won't become permanently blocked
     can_check_transmit_mailboxes();
-    // Make sure, the receiver is always on
-//    __HAL_CAN_ENABLE_IT(&hcan, CAN_IT_FMP0);
 }
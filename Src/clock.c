@@ -61,7 +61,8 @@ void SystemClock_Config()
     HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit);
     __SYSCFG_CLK_ENABLE();
 
-    HAL_SYSTICK_Config(HAL_RCC_GetHCLKFreq()/10000);
+    // Timing is based on the timebase, the tick only serves the HAL's timeouts in milliseconds.
+    HAL_SYSTICK_Config(HAL_RCC_GetHCLKFreq()/1000);
     HAL_SYSTICK_CLKSourceConfig(SYSTICK_CLKSOURCE_HCLK);
     HAL_NVIC_SetPriority(SysTick_IRQn, IRQ_PRIORITY_SYSTICK, 0);
 
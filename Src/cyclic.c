@@ -0,0 +1,239 @@
+/**
+ * @file
+ * @brief Cyclic transmission of CAN frames with timer-accurate periods
+ *
+ * Periodic frames are transmitted from the timebase interrupt,
+ * without any involvement of the PC. Both the timebase and the CAN interrupt
+ * run at the same priority, so they can not preempt each other
+ * and may both write to the transmit mailboxes.
+ */
+
+#include "cyclic.h"
+#include "platform.h"
+#include "config.h"
+#include "timebase.h"
+#include <error.h>
+
+
+/**
+ * Entry of the scheduler table
+ */
+typedef struct {
+    /** Frame to transmit */
+    can_frame_t frame;
+
+    /** Transmission period in microseconds, zero if not configured */
+    uint32_t period;
+
+    /** Delay of the first transmission in microseconds */
+    uint32_t phase;
+
+    /** Time of the next transmission */
+    uint32_t due;
+
+    /** Index of the payload byte to increment before each transmission */
+    uint8_t counter_byte;
+
+    /** Index of the payload byte to set to the XOR of the other bytes before each transmission */
+    uint8_t checksum_byte;
+
+    /** Whether a frame has been configured */
+    bool configured;
+
+    /** Whether the entry is being transmitted */
+    volatile bool active;
+
+    /** Whether the frame came due, but could not be loaded into a mailbox yet */
+    volatile bool pending;
+} cyclic_entry_t;
+
+
+static cyclic_entry_t cyclic_table[CYCLIC_TABLE_LENGTH];
+
+
+int8_t cyclic_set_frame(uint8_t index, const can_frame_t* frame)
+{
+    if (index >= CYCLIC_TABLE_LENGTH)
+        return ERROR_CYCLIC_INVALID_ENTRY;
+
+    cyclic_stop(index);
+    cyclic_table[index].frame = *frame;
+    cyclic_table[index].counter_byte = CYCLIC_BYTE_NONE;
+    cyclic_table[index].checksum_byte = CYCLIC_BYTE_NONE;
+    cyclic_table[index].configured = true;
+    return SUCCESS;
+}
+
+
+int8_t cyclic_set_timing(uint8_t index, uint32_t period, uint32_t phase)
+{
+    if (index >= CYCLIC_TABLE_LENGTH)
+        return ERROR_CYCLIC_INVALID_ENTRY;
+    if (period < CYCLIC_MIN_PERIOD || period > 0x7FFFFFFF || phase > 0x7FFFFFFF)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    cyclic_stop(index);
+    cyclic_table[index].period = period;
+    cyclic_table[index].phase = phase;
+    return SUCCESS;
+}
+
+
+int8_t cyclic_set_update_bytes(uint8_t index, uint8_t counter, uint8_t checksum)
+{
+    if (index >= CYCLIC_TABLE_LENGTH)
+        return ERROR_CYCLIC_INVALID_ENTRY;
+    if ((counter > 7 && counter != CYCLIC_BYTE_NONE)
+     || (checksum > 7 && checksum != CYCLIC_BYTE_NONE)
+     || (counter == checksum && counter != CYCLIC_BYTE_NONE))
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    // Takes effect with the next transmission
+    enter_critical();
+    cyclic_table[index].counter_byte = counter;
+    cyclic_table[index].checksum_byte = checksum;
+    exit_critical();
+    return SUCCESS;
+}
+
+
+/**
+ * Schedules the alarm for the entry, which is due next
+ *
+ * Must be called with the timebase interrupt blocked.
+ */
+static void cyclic_update_alarm(void)
+{
+    uint32_t next = 0;
+    bool any = false;
+
+    for (uint8_t i=0; i<CYCLIC_TABLE_LENGTH; i++)
+    {
+        if (!cyclic_table[i].active)
+            continue;
+        if (!any || (int32_t) (cyclic_table[i].due - next) < 0)
+            next = cyclic_table[i].due;
+        any = true;
+    }
+
+    if (any)
+        timebase_set_alarm(TIMEBASE_ALARM_CYCLIC, next);
+    else
+        timebase_cancel_alarm(TIMEBASE_ALARM_CYCLIC);
+}
+
+
+int8_t cyclic_start(uint8_t index)
+{
+    if (index != CYCLIC_ALL_ENTRIES && index >= CYCLIC_TABLE_LENGTH)
+        return ERROR_CYCLIC_INVALID_ENTRY;
+    if (index != CYCLIC_ALL_ENTRIES
+     && (!cyclic_table[index].configured || cyclic_table[index].period == 0))
+        return ERROR_CYCLIC_INVALID_ENTRY;
+
+    enter_critical();
+    // Common reference point for the phases
+    uint32_t now = now_us();
+    for (uint8_t i=0; i<CYCLIC_TABLE_LENGTH; i++)
+    {
+        cyclic_entry_t* entry = &cyclic_table[i];
+        if (index != CYCLIC_ALL_ENTRIES && index != i)
+            continue;
+        if (!entry->configured || entry->period == 0)
+            continue;
+        entry->due = now + entry->phase;
+        entry->pending = false;
+        entry->active = true;
+    }
+    cyclic_update_alarm();
+    exit_critical();
+    return SUCCESS;
+}
+
+
+void cyclic_stop(uint8_t index)
+{
+    enter_critical();
+    for (uint8_t i=0; i<CYCLIC_TABLE_LENGTH; i++)
+    {
+        if (index != CYCLIC_ALL_ENTRIES && index != i)
+            continue;
+        cyclic_table[i].active = false;
+        cyclic_table[i].pending = false;
+    }
+    cyclic_update_alarm();
+    exit_critical();
+}
+
+
+void cyclic_clear(void)
+{
+    cyclic_stop(CYCLIC_ALL_ENTRIES);
+    for (uint8_t i=0; i<CYCLIC_TABLE_LENGTH; i++)
+    {
+        cyclic_table[i].configured = false;
+        cyclic_table[i].period = 0;
+        cyclic_table[i].counter_byte = CYCLIC_BYTE_NONE;
+        cyclic_table[i].checksum_byte = CYCLIC_BYTE_NONE;
+    }
+}
+
+
+/**
+ * Updates counter and checksum byte of an entry's payload
+ */
+static inline void cyclic_update_payload(cyclic_entry_t* entry)
+{
+    can_frame_t* frame = &entry->frame;
+
+    if (entry->counter_byte < frame->dlc)
+        frame->data[entry->counter_byte]++;
+
+    if (entry->checksum_byte < frame->dlc)
+    {
+        uint8_t checksum = 0;
+        for (uint8_t j=0; j<frame->dlc; j++)
+            if (j != entry->checksum_byte)
+                checksum ^= frame->data[j];
+        frame->data[entry->checksum_byte] = checksum;
+    }
+}
+
+
+void cyclic_load_pending(void)
+{
+    for (uint8_t i=0; i<CYCLIC_TABLE_LENGTH; i++)
+    {
+        cyclic_entry_t* entry = &cyclic_table[i];
+        if (!entry->pending)
+            continue;
+        if (!can_transmit_immediately(&entry->frame))
+            // All mailboxes occupied again
+            return;
+        entry->pending = false;
+    }
+}
+
+
+void cyclic_alarm(void)
+{
+    uint32_t now = now_us();
+
+    for (uint8_t i=0; i<CYCLIC_TABLE_LENGTH; i++)
+    {
+        cyclic_entry_t* entry = &cyclic_table[i];
+        if (!entry->active || !timebase_is_due(entry->due, now))
+            continue;
+
+        // If the previous frame is still pending, it is replaced by the current one.
+        cyclic_update_payload(entry);
+        entry->pending = !can_transmit_immediately(&entry->frame);
+
+        // Advance by whole periods, so the phase is kept, even if periods were missed
+        do {
+            entry->due += entry->period;
+        } while (timebase_is_due(entry->due, now));
+    }
+
+    cyclic_update_alarm();
+}
@@ -1,5 +1,6 @@
 
 #include "fifo.h"
+#include <string.h>
 
 
 void fifo_init(fifo_t* fifo, uint8_t* buffer, uint16_t size)
@@ -7,28 +8,50 @@ void fifo_init(fifo_t* fifo, uint8_t* buffer, uint16_t size)
     fifo->buffer = buffer;
     fifo->size = size;
 
-    // Reset byte indices
+    // Reset byte and record counters
     fifo->push_index = 0;
     fifo->pop_index = 0;
+    fifo->push_records = 0;
+    fifo->pop_records = 0;
 }
 
 
-bool fifo_has_room(fifo_t* fifo, uint8_t length)
+/**
+ * Copies data into the buffer, starting at the given byte counter,
+ * in at most two contiguous segments: up to the end of the buffer and from its start
+ */
+static void fifo_copy_in(fifo_t* fifo, uint16_t index, uint8_t* data, uint16_t length)
 {
-    // The buffer can't store more than buffer size-1 bytes.
-    if (length+1 >= fifo->size)
-        return false;
+    uint16_t offset = index & (fifo->size - 1);
+    uint16_t first = fifo->size - offset;
+    if (first > length)
+        first = length;
+    memcpy(&fifo->buffer[offset], data, first);
+    memcpy(fifo->buffer, &data[first], length - first);
+}
 
-    // The buffer is full, when pushing any amount of bytes between 1 and length+1
-    // would increment the push_index to match the pop_index.
-    for (uint16_t l=1; l<=length+1; l++)
-    {
-        if ((fifo->push_index + l) % fifo->size == fifo->pop_index)
-        {
-            return false;
-        }
-    }
-    return true;
+
+/**
+ * Copies data out of the buffer, starting at the given byte counter,
+ * in at most two contiguous segments
+ */
+static void fifo_copy_out(fifo_t* fifo, uint16_t index, uint8_t* data, uint16_t length)
+{
+    uint16_t offset = index & (fifo->size - 1);
+    uint16_t first = fifo->size - offset;
+    if (first > length)
+        first = length;
+    memcpy(data, &fifo->buffer[offset], first);
+    memcpy(&data[first], fifo->buffer, length - first);
+}
+
+
+bool fifo_has_room(fifo_t* fifo, uint16_t length)
+{
+    // Both counters wrap around at 2^16, which is a multiple of the buffer size,
+    // so their difference is the number of stored bytes even after a wrap-around.
+    uint16_t used = fifo->push_index - fifo->pop_index;
+    return (length <= fifo->size - used);
 }
 
 
@@ -42,39 +65,9 @@ bool fifo_is_empty(fifo_t* fifo)
 
 uint16_t fifo_get_length(fifo_t* fifo)
 {
-    if (fifo->push_index < fifo->pop_index)
-    {
-        return (fifo->push_index + fifo->size) - fifo->pop_index;
-    }
-    if (fifo->push_index > fifo->pop_index)
-    {
-        return fifo->push_index - fifo->pop_index;
-    }
-    // fifo->push_index == fifo->pop_index: Buffer is empty
-    return 0;
-}
-
-
-bool fifo_has_slcan_command(fifo_t* fifo, uint16_t* length)
-{
-    *length = 0;
-    if (fifo_is_empty(fifo))
-        return false;
-
-    uint16_t l = fifo_get_length(fifo);
-    for (uint16_t i=0; i<l; i++)
-    {
-        uint16_t index = fifo->pop_index + i;
-        if (index >= fifo->size)
-            index -= fifo->size;
-        if (fifo->buffer[index] == SLCAN_COMMAND_TERMINATOR)
-        {
-            *length = i+1;
-            return true;
-        }
-    }
-
-    return false;
+    // The other side may modify its counter at any time,
+    // but each counter is read exactly once here.
+    return (uint16_t) (fifo->push_index - fifo->pop_index);
 }
 
 
@@ -84,14 +77,12 @@ bool fifo_push(fifo_t* fifo, uint8_t* data, uint16_t length)
         // There is not enough free space in the buffer.
         return false;
 
-    for (uint16_t i=0; i<length; i++)
-    {
-        // Copy byte to buffer
-        fifo->buffer[fifo->push_index] = data[i];
+    uint16_t push_index = fifo->push_index;
+    fifo_copy_in(fifo, push_index, data, length);
 
-        // Increment the push_index
-        fifo->push_index = (fifo->push_index + 1) % fifo->size;
-    }
+    // Publish all bytes at once, only after they have been written
+    __DMB();
+    fifo->push_index = push_index + length;
     return true;
 }
 
@@ -102,13 +93,73 @@ bool fifo_pop(fifo_t* fifo, uint8_t* data, uint16_t length)
         // There is fewer bytes in the buffer than requested.
         return false;
 
-    for (uint16_t i=0; i<length; i++)
-    {
-        // Copy byte from buffer
-        data[i] = fifo->buffer[fifo->pop_index];
+    // Don't read data before the producer's push_index update has been observed
+    __DMB();
+    uint16_t pop_index = fifo->pop_index;
+    fifo_copy_out(fifo, pop_index, data, length);
 
-        // Increment the pop_index
-        fifo->pop_index = (fifo->pop_index + 1) % fifo->size;
-    }
+    // Release the bytes to the producer only after they have been read
+    __DMB();
+    fifo->pop_index = pop_index + length;
     return true;
 }
+
+
+uint16_t fifo_get_record_count(fifo_t* fifo)
+{
+    return (uint16_t) (fifo->push_records - fifo->pop_records);
+}
+
+
+bool fifo_has_record(fifo_t* fifo, uint16_t* length)
+{
+    *length = 0;
+    if (fifo_get_record_count(fifo) == 0)
+        return false;
+
+    // Don't read the length prefix before the producer's counter updates have been observed
+    __DMB();
+    *length = fifo->buffer[fifo->pop_index & (fifo->size - 1)];
+    return true;
+}
+
+
+bool fifo_push_record(fifo_t* fifo, uint8_t* data, uint8_t length)
+{
+    if (!fifo_has_room(fifo, length + 1))
+        // There is not enough free space in the buffer.
+        return false;
+
+    uint16_t push_index = fifo->push_index;
+    fifo->buffer[push_index & (fifo->size - 1)] = length;
+    fifo_copy_in(fifo, push_index + 1, data, length);
+
+    // Publish the complete record at once, only after it has been written.
+    // The record counter is updated last, so a counted record is always complete.
+    __DMB();
+    fifo->push_index = push_index + length + 1;
+    fifo->push_records++;
+    return true;
+}
+
+
+uint16_t fifo_pop_record(fifo_t* fifo, uint8_t* data, uint16_t max_length)
+{
+    uint16_t stored_length;
+    if (!fifo_has_record(fifo, &stored_length))
+        return 0;
+
+    uint16_t pop_index = fifo->pop_index;
+    uint16_t length = stored_length;
+    if (length <= max_length)
+        fifo_copy_out(fifo, pop_index + 1, data, length);
+    else
+        // Record doesn't fit into the provided buffer: Discard it.
+        length = 0;
+
+    // Release the bytes to the producer only after they have been read
+    __DMB();
+    fifo->pop_index = pop_index + stored_length + 1;
+    fifo->pop_records++;
+    return length;
+}
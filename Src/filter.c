@@ -0,0 +1,987 @@
+/**
+ * @file
+ * @brief Acceptance filter manager
+ *
+ * Maintains a set of identifiers and identifier ranges and packs it into the filter banks:
+ * Each range is split into aligned blocks, each of which is expressed by an identifier and a mask.
+ * Blocks of a single identifier go into list mode banks, if remote frames are not needed,
+ * all others into mask mode banks. Standard identifiers use 16 bit scale, i.e. two masks
+ * or four identifiers per bank, extended identifiers 32 bit scale, i.e. one mask or two identifiers per bank.
+ * Consecutive banks alternate between the two reception FIFOs,
+ * while each identifier always ends up in the same FIFO.
+ *
+ * The optional software stage filters the frames, which passed the banks, exactly:
+ * standard identifiers by a bitmap, extended identifiers by an open-addressed hash set
+ * with linear probing, in which no identifier is further than @ref FILTER_SOFTWARE_MAX_PROBES
+ * slots from its home slot, so a lookup takes constant time.
+ *
+ * Every entry of the set refers to one of the @ref FILTER_POLICY_COUNT policies.
+ * Blocks only merge with blocks of the same policy, and programming the banks records
+ * the policy of every filter number, so the receive interrupt finds the policy of a frame
+ * by its filter match index (FMI) alone.
+ */
+
+#include "filter.h"
+#include "can.h"
+#include "frame_cache.h"
+#include "timebase.h"
+#include "platform.h"
+#include "config.h"
+#include <error.h>
+#include <stddef.h>
+
+
+/**
+ * Identifier range; bit 31 of first is set for extended identifiers, bits 30-29 hold the policy
+ */
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+} filter_entry_t;
+
+/**
+ * Identifiers matching value under mask; bit 31 of value is set for extended identifiers,
+ * bits 30-29 hold the policy
+ */
+typedef struct {
+    uint32_t value;
+    uint32_t mask;
+} filter_block_t;
+
+#define FILTER_EXTENDED         0x80000000
+#define FILTER_POLICY_SHIFT     29
+#define FILTER_POLICY           (0x3UL << FILTER_POLICY_SHIFT)
+/** Bits, which must be equal for blocks to merge */
+#define FILTER_KIND             (FILTER_EXTENDED | FILTER_POLICY)
+#define FILTER_STD_ID_MASK      0x7FF
+#define FILTER_EXT_ID_MASK      0x1FFFFFFF
+
+/**
+ * Maximum number of blocks, i.e. as many standard identifiers as fit into all banks
+ */
+#define FILTER_BLOCK_LIMIT      (4 * FILTER_BANK_COUNT)
+
+/**
+ * Quarter banks, by which the split blocks may exceed the banks before merging, see @ref filter_pack
+ */
+#ifndef FILTER_PACK_SLACK
+#define FILTER_PACK_SLACK       32
+#endif
+
+#if FILTER_TABLE_LENGTH > FILTER_BLOCK_LIMIT
+#error "FILTER_TABLE_LENGTH must not exceed the number of blocks, 4 * FILTER_BANK_COUNT"
+#endif
+
+
+static filter_entry_t filter_table[FILTER_TABLE_LENGTH];
+static uint8_t filter_count = 0;
+static bool data_only = false;
+
+/*
+ * Result of the last packing
+ */
+static filter_block_t blocks[FILTER_BLOCK_LIMIT];
+static uint8_t block_count;
+static uint8_t bank_count;
+static bool exact;
+
+/*
+ * Software stage
+ */
+/** Maximum number of slots a lookup in the hash set examines */
+#define FILTER_SOFTWARE_MAX_PROBES  8
+
+static volatile bool software_enabled = false;
+static uint32_t software_dropped;
+static uint8_t standard_bitmap[(FILTER_STD_ID_MASK + 1) / 8];
+/** Identifiers with bit 31 set, so an empty slot is zero */
+static uint32_t extended_set[FILTER_EXTENDED_SET_LENGTH];
+static uint8_t extended_count = 0;
+
+/*
+ * Policies
+ */
+typedef struct {
+    /** See @ref filter_action */
+    uint8_t action;
+    /** Whether a frame has been forwarded since the policy was set */
+    bool forwarded;
+    /** See @ref filter_policy_status_t.interval */
+    uint32_t interval;
+    /** Time of the last forwarded frame */
+    uint32_t last_time;
+    uint32_t frames;
+    /** Frames until the next forwarded one, for @ref FILTER_ACTION_DECIMATE */
+    uint32_t countdown;
+} filter_policy_t;
+
+static filter_policy_t policies[FILTER_POLICY_COUNT];
+
+/**
+ * Frame held back by a rate limit policy until the end of its window
+ */
+typedef struct {
+    can_frame_t frame;
+    /** Start of the window */
+    uint32_t start;
+    /** Policy holding the frame plus one, zero if the slot is free */
+    uint8_t owner;
+} filter_held_t;
+
+static filter_held_t held[FILTER_HELD_LENGTH];
+/** Frames not held back, as all slots were taken */
+static uint32_t held_dropped = 0;
+
+/** Earliest end of a window with a pending frame, if scheduled */
+static bool alarm_scheduled = false;
+static uint32_t alarm_time;
+
+/**
+ * Period in microseconds, in which @ref filter_process forgets the times of frames
+ * forwarded 2^31 us or more ago, so the time elapsed since never exceeds 2^32 us
+ */
+#define FILTER_AGING_PERIOD     0x10000000
+
+/** Time of the next aging, see @ref filter_process */
+static uint32_t aging_time = 0;
+
+/**
+ * Maximum number of filter numbers per FIFO: half of the banks with four numbers each
+ */
+#define FILTER_NUMBER_COUNT     (4 * FILTER_BANK_COUNT / 2)
+
+/** Policy by FIFO and filter number, four 2 bit fields per byte */
+static uint8_t number_policy[2][FILTER_NUMBER_COUNT / 4];
+
+
+static inline uint32_t filter_id_mask(uint32_t value)
+{
+    return (value & FILTER_EXTENDED) ? FILTER_EXT_ID_MASK : FILTER_STD_ID_MASK;
+}
+
+
+static inline bool filter_block_is_single(const filter_block_t* block)
+{
+    return (block->mask == filter_id_mask(block->value));
+}
+
+
+/**
+ * Returns whether block a accepts all identifiers block b accepts
+ */
+static inline bool filter_block_covers(const filter_block_t* a, const filter_block_t* b)
+{
+    return ((a->value & FILTER_KIND) == (b->value & FILTER_KIND))
+        && ((b->mask & a->mask) == a->mask)
+        && ((b->value & a->mask) == (a->value & ~FILTER_KIND));
+}
+
+
+static void filter_remove_block(uint8_t index)
+{
+    blocks[index] = blocks[--block_count];
+}
+
+
+/**
+ * Returns the number of banks needed for the current blocks
+ *
+ * @param single_into_mask  Set, if the last single standard identifier
+ *                          should fill the spare slot of a mask bank
+ */
+static uint8_t filter_count_banks(bool* single_into_mask)
+{
+    uint8_t std_single = 0, std_mask = 0, ext_single = 0, ext_mask = 0;
+
+    for (uint8_t i=0; i<block_count; i++) {
+        bool single = data_only && filter_block_is_single(&blocks[i]);
+        if (blocks[i].value & FILTER_EXTENDED) {
+            if (single) ext_single++; else ext_mask++;
+        } else {
+            if (single) std_single++; else std_mask++;
+        }
+    }
+
+    *single_into_mask = ((std_mask % 2) == 1) && ((std_single % 4) == 1);
+    if (*single_into_mask) {
+        std_single--;
+        std_mask++;
+    }
+
+    return (std_single + 3) / 4 + (std_mask + 1) / 2 + (ext_single + 1) / 2 + ext_mask;
+}
+
+
+/**
+ * Replaces the two blocks of the same frame type and policy, whose combination accepts the fewest identifiers,
+ * by their combination and removes the blocks it covers
+ *
+ * @return false, if there were no two blocks of the same frame type and policy
+ */
+static bool filter_merge_closest(void)
+{
+    int8_t best_i = -1, best_j = -1;
+    uint8_t best_bits = 0;
+    filter_block_t merged;
+
+    for (uint8_t i=0; i<block_count; i++) {
+        for (uint8_t j=i+1; j<block_count; j++) {
+            if ((blocks[i].value ^ blocks[j].value) & FILTER_KIND)
+                continue;
+            uint32_t mask = blocks[i].mask & blocks[j].mask & ~(blocks[i].value ^ blocks[j].value);
+            // The more bits the mask keeps, the fewer identifiers the combination accepts
+            uint8_t bits = __builtin_popcount(mask) + ((blocks[i].value & FILTER_EXTENDED) ? 0 : 18);
+            if (best_i < 0 || bits > best_bits) {
+                best_i = i;
+                best_j = j;
+                best_bits = bits;
+            }
+        }
+    }
+    if (best_i < 0)
+        return false;
+
+    merged.mask = blocks[best_i].mask & blocks[best_j].mask & ~(blocks[best_i].value ^ blocks[best_j].value) & ~FILTER_KIND;
+    merged.value = (blocks[best_i].value & merged.mask) | (blocks[best_i].value & FILTER_KIND);
+    exact = false;
+
+    blocks[best_i] = merged;
+    for (uint8_t k=0; k<block_count; ) {
+        if (k != best_i && filter_block_covers(&merged, &blocks[k])) {
+            filter_remove_block(k);
+            if (best_i == block_count)
+                // The merged block was moved into the gap
+                best_i = k;
+        } else {
+            k++;
+        }
+    }
+    return true;
+}
+
+
+/**
+ * Adds a block, unless it is covered by an existing one
+ */
+static void filter_add_block(uint32_t value, uint32_t mask)
+{
+    filter_block_t block = {.value = value, .mask = mask};
+
+    for (uint8_t i=0; i<block_count; ) {
+        if (filter_block_covers(&blocks[i], &block))
+            return;
+        if (filter_block_covers(&block, &blocks[i]))
+            filter_remove_block(i);
+        else
+            i++;
+    }
+
+    // Not reached, as filter_pack budgets the blocks; merging keeps the array safe nonetheless
+    if (block_count >= FILTER_BLOCK_LIMIT)
+        filter_merge_closest();
+
+    blocks[block_count++] = block;
+}
+
+
+/**
+ * Returns the share of a bank a block takes, in quarters, see @ref filter_count_banks
+ */
+static inline uint8_t filter_block_cost(uint32_t type, bool single)
+{
+    if (single && data_only)
+        return (type & FILTER_EXTENDED) ? 2 : 1;
+    return (type & FILTER_EXTENDED) ? 4 : 2;
+}
+
+
+/**
+ * Blocks and their share of the banks, summed up by @ref filter_split
+ */
+typedef struct {
+    uint32_t blocks;
+    /** In quarter banks, see @ref filter_block_cost */
+    uint32_t quarters;
+} filter_cost_t;
+
+
+/**
+ * Returns whether blocks of the given cost may be merged into the banks, see @ref filter_pack
+ */
+static inline bool filter_cost_fits(const filter_cost_t* cost)
+{
+    return cost->quarters <= 4 * FILTER_BANK_COUNT + FILTER_PACK_SLACK && cost->blocks <= FILTER_BLOCK_LIMIT;
+}
+
+
+/**
+ * Splits an identifier range into aligned blocks of at least 2^shift identifiers,
+ * widening the range to multiples of 2^shift
+ *
+ * @param add   Whether to add the blocks or only to sum up their cost;
+ *              in the latter case, the split stops as soon as the cost no longer fits
+ * @param cost  Cost to add the blocks to
+ */
+static void filter_split(uint32_t type, uint32_t first, uint32_t last, uint8_t shift, bool add, filter_cost_t* cost)
+{
+    uint32_t id_mask = filter_id_mask(type);
+    uint32_t granule = (1UL << shift) - 1;
+
+    first &= ~granule;
+    last |= granule;
+    while (true) {
+        // Largest aligned block starting at first, which does not exceed last
+        uint32_t size = first ? (first & -first) : id_mask + 1;
+        while (first + size - 1 > last)
+            size >>= 1;
+
+        if (add)
+            filter_add_block(type | first, id_mask & ~(size - 1));
+        cost->blocks++;
+        cost->quarters += filter_block_cost(type, size == 1);
+
+        if (first + size - 1 >= last || (!add && !filter_cost_fits(cost)))
+            return;
+        first += size;
+    }
+}
+
+
+/**
+ * Returns the smallest shift, for which @ref filter_split turns the range into a single block
+ */
+static inline uint8_t filter_single_block_shift(uint32_t first, uint32_t last)
+{
+    uint32_t differing = first ^ last;
+    uint8_t shift = 0;
+
+    while (differing) {
+        differing >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+
+/**
+ * Splits all entries with the given shift, see @ref filter_split
+ *
+ * An entry is never split coarser than into a single block.
+ *
+ * @return Whether the cost of the blocks fits, see @ref filter_cost_fits;
+ *         without adding, the split stops as soon as it no longer does
+ */
+static bool filter_split_all(uint8_t shift, bool add)
+{
+    filter_cost_t cost = {0, 0};
+
+    for (uint8_t i=0; i<filter_count; i++) {
+        uint32_t type = filter_table[i].first & FILTER_KIND;
+        uint32_t first = filter_table[i].first & filter_id_mask(type);
+        uint32_t last = filter_table[i].last;
+        uint8_t entry_shift = filter_single_block_shift(first, last);
+        uint32_t granule;
+
+        if (shift < entry_shift)
+            entry_shift = shift;
+        granule = (1UL << entry_shift) - 1;
+        if (add && ((first & granule) != 0 || (last & granule) != granule))
+            // Widened
+            exact = false;
+        filter_split(type, first, last, entry_shift, add, &cost);
+        if (!add && !filter_cost_fits(&cost))
+            return false;
+    }
+    return filter_cost_fits(&cost);
+}
+
+
+/**
+ * Splits the set into aligned blocks and merges them, until they fit into the banks
+ *
+ * All entries are split with the same coarseness, the finest one, for which the blocks
+ * fit into the banks plus @ref FILTER_PACK_SLACK quarters and into @ref FILTER_BLOCK_LIMIT.
+ * Finding it is a binary search over the at most 29 bits of an identifier, i.e. at most
+ * six splits of the whole set, each stopped as soon as the blocks exceed the budget.
+ * The merges afterwards spend the slack on combining the closest blocks;
+ * each removes at least one block and compares all pairs of the remaining ones,
+ * which bounds packing to about FILTER_BLOCK_LIMIT^3 / 6, i.e. 30 000 comparisons,
+ * some ten milliseconds at worst. Typical sets need a few merges.
+ */
+static void filter_pack(void)
+{
+    bool single_into_mask;
+    uint8_t low = 0, high = 29;
+
+    while (low < high) {
+        uint8_t shift = (low + high) / 2;
+        if (filter_split_all(shift, false))
+            high = shift;
+        else
+            low = shift + 1;
+    }
+
+    block_count = 0;
+    exact = true;
+    filter_split_all(low, true);
+
+    while (filter_count_banks(&single_into_mask) > FILTER_BANK_COUNT)
+        filter_merge_closest();
+    bank_count = filter_count_banks(&single_into_mask);
+}
+
+
+/*
+ * Bank being filled while programming
+ */
+static uint8_t bank;
+static uint32_t slot_id[4];
+static uint32_t slot_mask[4];
+static uint8_t slot_policy[4];
+static uint8_t slot_count;
+/** Next filter number by FIFO */
+static uint8_t next_number[2];
+
+
+/**
+ * Programs the bank being filled and continues with the next one
+ */
+static void filter_write_bank(enum can_filter_mode mode)
+{
+    uint32_t fr1, fr2;
+    uint8_t fifo = bank & 1;
+    uint8_t numbers = (mode == CAN_FILTER_LIST_16BIT) ? 4 : (mode == CAN_FILTER_MASK_32BIT) ? 1 : 2;
+
+    if (slot_count == 0)
+        return;
+    // Unused slots repeat the first one
+    for (uint8_t i=slot_count; i<4; i++) {
+        slot_id[i] = slot_id[0];
+        slot_mask[i] = slot_mask[0];
+        slot_policy[i] = slot_policy[0];
+    }
+
+    // Filter numbers count the slots of all banks assigned to the same FIFO in order
+    for (uint8_t i=0; i<numbers; i++) {
+        uint8_t number = next_number[fifo]++;
+        number_policy[fifo][number / 4] |= slot_policy[i] << (2 * (number % 4));
+    }
+
+    switch (mode) {
+    case CAN_FILTER_LIST_16BIT:
+        fr1 = (slot_id[1] << 16) | slot_id[0];
+        fr2 = (slot_id[3] << 16) | slot_id[2];
+        break;
+    case CAN_FILTER_MASK_16BIT:
+        fr1 = (slot_mask[0] << 16) | slot_id[0];
+        fr2 = (slot_mask[1] << 16) | slot_id[1];
+        break;
+    case CAN_FILTER_LIST_32BIT:
+        fr1 = slot_id[0];
+        fr2 = slot_id[1];
+        break;
+    default:
+        fr1 = slot_id[0];
+        fr2 = slot_mask[0];
+        break;
+    }
+
+    can_configure_filter_bank(bank, mode, fr1, fr2, fifo ? CAN_FIFO1 : CAN_FIFO0);
+    bank++;
+    slot_count = 0;
+}
+
+
+/**
+ * Programs all blocks of one kind into banks of the given mode
+ *
+ * @param mode      Bank mode, which determines the kind of blocks and slots per bank
+ * @param extended  Whether to program the blocks of extended or standard identifiers
+ * @param single    Whether to program the blocks of single identifiers or the others
+ * @param last_single Index of the single standard identifier to treat as mask, or -1
+ */
+static void filter_write_blocks(enum can_filter_mode mode, bool extended, bool single, int8_t last_single)
+{
+    uint8_t slots = (mode == CAN_FILTER_LIST_16BIT) ? 4 : (mode == CAN_FILTER_MASK_32BIT) ? 1 : 2;
+
+    for (uint8_t i=0; i<block_count; i++) {
+        bool block_single = data_only && filter_block_is_single(&blocks[i]) && (i != last_single);
+        if (((blocks[i].value & FILTER_EXTENDED) != 0) != extended || block_single != single)
+            continue;
+
+        uint32_t id = blocks[i].value & ~FILTER_KIND;
+        slot_policy[slot_count] = (blocks[i].value & FILTER_POLICY) >> FILTER_POLICY_SHIFT;
+        if (extended) {
+            slot_id[slot_count] = (id << CAN_FILTER_EXID_SHIFT) | CAN_FILTER_IDE;
+            slot_mask[slot_count] = (blocks[i].mask << CAN_FILTER_EXID_SHIFT) | CAN_FILTER_IDE
+                                  | (data_only ? CAN_FILTER_RTR : 0);
+        } else {
+            slot_id[slot_count] = id << CAN_FILTER16_STID_SHIFT;
+            slot_mask[slot_count] = (blocks[i].mask << CAN_FILTER16_STID_SHIFT) | CAN_FILTER16_IDE
+                                  | (data_only ? CAN_FILTER16_RTR : 0);
+        }
+        if (++slot_count == slots)
+            filter_write_bank(mode);
+    }
+    filter_write_bank(mode);
+}
+
+
+void filter_apply(void)
+{
+    bool single_into_mask;
+    int8_t last_single = -1;
+
+    filter_pack();
+
+    if (can_get_bus_state() != ON_BUS)
+        return;
+
+    // The reception interrupt looks up the policies of the banks being written
+    enter_critical();
+    for (uint8_t i=0; i<sizeof(number_policy); i++)
+        number_policy[i / sizeof(number_policy[0])][i % sizeof(number_policy[0])] = 0;
+    next_number[0] = 0;
+    next_number[1] = 0;
+
+    if (filter_count == 0) {
+        // Accept all frames with policy 0
+        can_set_filter(0, 0);
+        exit_critical();
+        return;
+    }
+
+    filter_count_banks(&single_into_mask);
+    if (single_into_mask)
+        for (uint8_t i=0; i<block_count; i++)
+            if (!(blocks[i].value & FILTER_EXTENDED) && filter_block_is_single(&blocks[i]))
+                last_single = i;
+
+    bank = 0;
+    slot_count = 0;
+    if (data_only) {
+        filter_write_blocks(CAN_FILTER_LIST_16BIT, false, true, last_single);
+        filter_write_blocks(CAN_FILTER_LIST_32BIT, true, true, -1);
+    }
+    filter_write_blocks(CAN_FILTER_MASK_16BIT, false, false, last_single);
+    filter_write_blocks(CAN_FILTER_MASK_32BIT, true, false, -1);
+
+    while (bank < FILTER_BANK_COUNT)
+        can_configure_filter_bank(bank++, CAN_FILTER_DISABLED, 0, 0, CAN_FIFO0);
+    exit_critical();
+}
+
+
+int8_t filter_add(bool extended, uint32_t first, uint32_t last, uint8_t policy)
+{
+    uint32_t type = extended ? FILTER_EXTENDED : 0;
+
+    if (first > last || last > filter_id_mask(type) || policy >= FILTER_POLICY_COUNT)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    for (uint8_t i=0; i<filter_count; i++) {
+        if ((filter_table[i].first & ~FILTER_POLICY) == (type | first) && filter_table[i].last == last) {
+            // Already in the set: change the policy
+            filter_table[i].first = type | first | ((uint32_t) policy << FILTER_POLICY_SHIFT);
+            filter_apply();
+            return SUCCESS;
+        }
+    }
+
+    if (filter_count >= FILTER_TABLE_LENGTH)
+        return ERROR_FILTER_TABLE_FULL;
+
+    filter_table[filter_count].first = type | first | ((uint32_t) policy << FILTER_POLICY_SHIFT);
+    filter_table[filter_count].last = last;
+    filter_count++;
+
+    filter_apply();
+    return SUCCESS;
+}
+
+
+int8_t filter_remove(bool extended, uint32_t first, uint32_t last)
+{
+    uint32_t type = extended ? FILTER_EXTENDED : 0;
+
+    for (uint8_t i=0; i<filter_count; i++) {
+        if ((filter_table[i].first & ~FILTER_POLICY) == (type | first) && filter_table[i].last == last) {
+            filter_table[i] = filter_table[--filter_count];
+            filter_apply();
+            return SUCCESS;
+        }
+    }
+    return ERROR_FILTER_NOT_FOUND;
+}
+
+
+void filter_clear(void)
+{
+    filter_count = 0;
+    filter_apply();
+}
+
+
+void filter_set_data_only(bool only)
+{
+    data_only = only;
+    filter_apply();
+}
+
+
+void filter_get_status(filter_status_t* status)
+{
+    status->entries = filter_count;
+    status->banks = (filter_count == 0) ? 4 : bank_count;
+    status->exact = exact;
+    status->software = software_enabled;
+    status->software_extended = extended_count;
+    status->software_dropped = software_dropped;
+    status->cache_evictions = frame_cache_get_evictions();
+    status->held_dropped = held_dropped;
+}
+
+
+/**
+ * Returns the home slot of an extended identifier in the hash set
+ */
+static inline uint8_t filter_extended_slot(uint32_t id)
+{
+    // Multiplicative hashing: the middle bits of the product depend on all bits of the identifier
+    return ((id * 2654435761UL) >> 16) & (FILTER_EXTENDED_SET_LENGTH - 1);
+}
+
+
+void filter_software_enable(bool enable)
+{
+    software_dropped = 0;
+    software_enabled = enable;
+}
+
+
+void filter_software_clear(void)
+{
+    for (uint16_t i=0; i<sizeof(standard_bitmap); i++)
+        standard_bitmap[i] = 0;
+    for (uint8_t i=0; i<FILTER_EXTENDED_SET_LENGTH; i++)
+        extended_set[i] = 0;
+    extended_count = 0;
+}
+
+
+int8_t filter_software_set_bitmap(uint8_t offset, const uint8_t* bits, uint8_t length)
+{
+    if (offset + length > sizeof(standard_bitmap))
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    for (uint8_t i=0; i<length; i++)
+        standard_bitmap[offset + i] = bits[i];
+    return SUCCESS;
+}
+
+
+int8_t filter_software_add_extended(uint32_t id)
+{
+    uint8_t slot = filter_extended_slot(id);
+
+    if (id > FILTER_EXT_ID_MASK)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    for (uint8_t i=0; i<FILTER_SOFTWARE_MAX_PROBES; i++) {
+        if (extended_set[slot] == (id | FILTER_EXTENDED))
+            return SUCCESS;
+        if (extended_set[slot] == 0) {
+            // A single store, so the receive interrupt never sees a partial entry
+            extended_set[slot] = id | FILTER_EXTENDED;
+            extended_count++;
+            return SUCCESS;
+        }
+        slot = (slot + 1) & (FILTER_EXTENDED_SET_LENGTH - 1);
+    }
+    // The neighborhood of the home slot is taken
+    return ERROR_FILTER_TABLE_FULL;
+}
+
+
+bool filter_software_accept(const can_frame_t* frame)
+{
+    bool accepted = false;
+
+    if (!software_enabled)
+        return true;
+
+    if (frame->flags & CAN_FRAME_FLAG_EXTENDED) {
+        uint8_t slot = filter_extended_slot(frame->id);
+        for (uint8_t i=0; i<FILTER_SOFTWARE_MAX_PROBES; i++) {
+            uint32_t entry = extended_set[slot];
+            if (entry == (frame->id | FILTER_EXTENDED)) {
+                accepted = true;
+                break;
+            }
+            if (entry == 0)
+                break;
+            slot = (slot + 1) & (FILTER_EXTENDED_SET_LENGTH - 1);
+        }
+    } else {
+        accepted = standard_bitmap[frame->id >> 3] & (1 << (frame->id & 7));
+    }
+
+    if (!accepted)
+        software_dropped++;
+    return accepted;
+}
+
+
+int8_t filter_set_policy(uint8_t index, enum filter_action action, uint32_t interval)
+{
+    filter_policy_t* policy;
+
+    if (index >= FILTER_POLICY_COUNT || action > FILTER_ACTION_DECIMATE_ID)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+    if ((action == FILTER_ACTION_ON_CHANGE || action == FILTER_ACTION_DECIMATE_ID) && interval > UINT8_MAX)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+    // The ends of the windows are scheduled as alarms, see timebase_is_due
+    if ((action == FILTER_ACTION_RATE_LIMIT || action == FILTER_ACTION_RATE_LIMIT_ID) && interval >= 0x80000000)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+    policy = &policies[index];
+
+    // The reception interrupt and the alarm use the policy
+    enter_critical();
+    policy->action = action;
+    policy->forwarded = false;
+    policy->interval = interval;
+    policy->last_time = 0;
+    policy->frames = 0;
+    policy->countdown = 0;
+    for (uint8_t i=0; i<FILTER_HELD_LENGTH; i++)
+        if (held[i].owner == index + 1)
+            held[i].owner = 0;
+    // Forward the next frame of every identifier
+    frame_cache_clear();
+    exit_critical();
+    return SUCCESS;
+}
+
+
+int8_t filter_get_policy(uint8_t index, filter_policy_status_t* status)
+{
+    if (index >= FILTER_POLICY_COUNT)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    status->action = policies[index].action;
+    status->interval = policies[index].interval;
+    status->frames = policies[index].frames;
+    return SUCCESS;
+}
+
+
+/**
+ * Makes sure, the alarm goes off at the end of a window with a pending frame
+ */
+static void filter_schedule_alarm(uint32_t time)
+{
+    if (alarm_scheduled && !timebase_is_due(time, alarm_time))
+        return;
+    alarm_scheduled = true;
+    alarm_time = time;
+    timebase_set_alarm(TIMEBASE_ALARM_FILTER, time);
+}
+
+
+/**
+ * Returns the slot, which holds a frame of a policy, with the identifier of the given frame
+ * unless any is set; otherwise a free slot, NULL if there is none
+ */
+static filter_held_t* filter_held_slot(uint8_t index, const can_frame_t* frame, bool any)
+{
+    filter_held_t* free_slot = NULL;
+
+    for (uint8_t i=0; i<FILTER_HELD_LENGTH; i++) {
+        if (held[i].owner == index + 1 && (any || (held[i].frame.id == frame->id
+                && ((held[i].frame.flags ^ frame->flags) & (CAN_FRAME_FLAG_EXTENDED | CAN_FRAME_FLAG_REMOTE)) == 0)))
+            return &held[i];
+        if (held[i].owner == 0 && free_slot == NULL)
+            free_slot = &held[i];
+    }
+    return free_slot;
+}
+
+
+/**
+ * Holds a frame back until the end of the window, which started at the given time,
+ * replacing an earlier frame of the policy resp. of the identifier
+ */
+static void filter_hold(uint8_t index, uint32_t start, const can_frame_t* frame, bool any)
+{
+    filter_held_t* slot = filter_held_slot(index, frame, any);
+
+    if (slot == NULL) {
+        held_dropped++;
+        return;
+    }
+    slot->frame = *frame;
+    slot->start = start;
+    slot->owner = index + 1;
+    filter_schedule_alarm(start + policies[index].interval);
+}
+
+
+/**
+ * Discards the frame held back by a policy resp. for the identifier of the given frame
+ */
+static void filter_discard_held(uint8_t index, const can_frame_t* frame, bool any)
+{
+    filter_held_t* slot = filter_held_slot(index, frame, any);
+
+    if (slot != NULL)
+        slot->owner = 0;
+}
+
+
+bool filter_policy_accept(uint8_t fifo, uint8_t number, const can_frame_t* frame)
+{
+    uint8_t index = 0;
+    filter_policy_t* policy;
+    frame_cache_entry_t* entry;
+    bool found;
+
+    if (number < FILTER_NUMBER_COUNT)
+        index = (number_policy[fifo][number / 4] >> (2 * (number % 4))) & 0x3;
+    policy = &policies[index];
+
+    switch (policy->action) {
+    case FILTER_ACTION_FORWARD:
+        policy->frames++;
+        return true;
+
+    case FILTER_ACTION_RATE_LIMIT:
+        policy->frames++;
+        // Unlike the end of the window, the time elapsed does not wrap, see filter_process
+        if (!policy->forwarded || frame->timestamp - policy->last_time >= policy->interval) {
+            // The window is over: forward this frame rather than an older one
+            filter_discard_held(index, frame, true);
+            break;
+        }
+        // Keep the latest frame of the window
+        filter_hold(index, policy->last_time, frame, true);
+        return false;
+
+    case FILTER_ACTION_RATE_LIMIT_ID:
+        policy->frames++;
+        entry = frame_cache_lookup(frame, index, &found);
+        // As for RATE_LIMIT, see filter_process
+        if (!found || frame->timestamp - entry->time >= policy->interval) {
+            filter_discard_held(index, frame, false);
+            entry->time = frame->timestamp;
+            break;
+        }
+        filter_hold(index, entry->time, frame, false);
+        return false;
+
+    case FILTER_ACTION_ON_CHANGE:
+        entry = frame_cache_lookup(frame, index, &found);
+        policy->frames++;
+        if (found && frame_cache_unchanged(entry, frame)) {
+            // Unless a keep-alive is due
+            if (policy->interval == 0 || ++entry->repeats < policy->interval)
+                return false;
+        }
+        frame_cache_store(entry, frame);
+        break;
+
+    case FILTER_ACTION_DECIMATE:
+        policy->frames++;
+        // Counting down avoids a division, which the Cortex-M0 lacks
+        if (policy->countdown > 1) {
+            policy->countdown--;
+            return false;
+        }
+        policy->countdown = policy->interval;
+        return true;
+
+    case FILTER_ACTION_DECIMATE_ID:
+        entry = frame_cache_lookup(frame, index, &found);
+        policy->frames++;
+        if (found && ++entry->repeats < policy->interval)
+            return false;
+        entry->repeats = 0;
+        return true;
+
+    case FILTER_ACTION_COUNT_ONLY:
+        policy->frames++;
+        return false;
+
+    default:
+        return false;
+    }
+
+    policy->forwarded = true;
+    policy->last_time = frame->timestamp;
+    return true;
+}
+
+
+void filter_alarm(void)
+{
+    uint32_t now = now_us();
+    bool next_scheduled = false;
+    uint32_t next = 0;
+
+    for (uint8_t i=0; i<FILTER_HELD_LENGTH; i++) {
+        if (held[i].owner == 0)
+            continue;
+
+        uint8_t index = held[i].owner - 1;
+        filter_policy_t* policy = &policies[index];
+        uint32_t end = held[i].start + policy->interval;
+        if (!timebase_is_due(end, now)) {
+            if (!next_scheduled || !timebase_is_due(next, end))
+                next = end;
+            next_scheduled = true;
+            continue;
+        }
+
+        // Forward the latest frame of the window with its time of reception
+        can_frame_t frame = held[i].frame;
+        held[i].owner = 0;
+        if (policy->action == FILTER_ACTION_RATE_LIMIT) {
+            policy->forwarded = true;
+            policy->last_time = now;
+        } else {
+            frame_cache_entry_t* entry = frame_cache_find(&frame, index);
+            if (entry != NULL)
+                entry->time = now;
+        }
+        can_queue_received(&frame);
+    }
+
+    alarm_scheduled = next_scheduled;
+    alarm_time = next;
+    if (next_scheduled)
+        timebase_set_alarm(TIMEBASE_ALARM_FILTER, next);
+    else
+        timebase_cancel_alarm(TIMEBASE_ALARM_FILTER);
+}
+
+
+void filter_process(void)
+{
+    uint32_t now = now_us();
+
+    if (!timebase_is_due(aging_time, now))
+        return;
+    aging_time = now + FILTER_AGING_PERIOD;
+
+    // The reception interrupt and the alarm use the policies;
+    // sample the time again, so no frame was forwarded after it.
+    enter_critical();
+    now = now_us();
+    for (uint8_t i=0; i<FILTER_POLICY_COUNT; i++) {
+        if (policies[i].forwarded && now - policies[i].last_time >= 0x80000000)
+            // Too old to be compared: the next frame starts a new window
+            policies[i].forwarded = false;
+        if (policies[i].action == FILTER_ACTION_RATE_LIMIT_ID)
+            frame_cache_expire(i, now);
+    }
+    exit_critical();
+}
@@ -0,0 +1,139 @@
+/**
+ * @file
+ * @brief Cache of the last payload by identifier, see @ref frame_cache_entry_t
+ */
+
+#include "frame_cache.h"
+#include "config.h"
+#include <stddef.h>
+
+
+#define FRAME_CACHE_SETS        (FRAME_CACHE_LENGTH / 2)
+
+static frame_cache_entry_t cache[FRAME_CACHE_SETS][2];
+/** Bit per set, set if its second entry was used more recently than the first one */
+static uint8_t recent[(FRAME_CACHE_SETS + 7) / 8];
+static uint32_t evictions = 0;
+
+
+/**
+ * Returns the key of a frame's identifier, which distinguishes
+ * standard, extended and remote frames
+ */
+static inline uint32_t frame_cache_key(const can_frame_t* frame)
+{
+    return frame->id
+         | FRAME_CACHE_VALID
+         | ((frame->flags & CAN_FRAME_FLAG_EXTENDED) ? 0x80000000 : 0)
+         | ((frame->flags & CAN_FRAME_FLAG_REMOTE) ? 0x20000000 : 0);
+}
+
+
+static inline uint8_t frame_cache_set(const can_frame_t* frame)
+{
+    // Multiplicative hashing: the middle bits of the product depend on all bits of the identifier
+    return ((frame->id * 2654435761UL) >> 16) & (FRAME_CACHE_SETS - 1);
+}
+
+
+frame_cache_entry_t* frame_cache_lookup(const can_frame_t* frame, uint8_t policy, bool* found)
+{
+    uint32_t key = frame_cache_key(frame);
+    uint8_t index = frame_cache_set(frame);
+    frame_cache_entry_t* set = cache[index];
+    uint8_t way;
+
+    *found = true;
+    if (set[0].key == key) {
+        way = 0;
+    } else if (set[1].key == key) {
+        way = 1;
+    } else {
+        *found = false;
+        way = (recent[index / 8] & (1 << (index % 8))) ? 0 : 1;
+        if (set[way].key != 0)
+            evictions++;
+        set[way].key = key;
+    }
+
+    if (set[way].policy != policy)
+        // The identifier moved to another policy, which uses the entry differently
+        *found = false;
+    if (!*found) {
+        set[way].policy = policy;
+        set[way].time = 0;
+        set[way].repeats = 0;
+    }
+
+    if (way)
+        recent[index / 8] |= 1 << (index % 8);
+    else
+        recent[index / 8] &= ~(1 << (index % 8));
+    return &set[way];
+}
+
+
+frame_cache_entry_t* frame_cache_find(const can_frame_t* frame, uint8_t policy)
+{
+    uint32_t key = frame_cache_key(frame);
+    frame_cache_entry_t* set = cache[frame_cache_set(frame)];
+
+    for (uint8_t way=0; way<2; way++) {
+        if (set[way].key == key && set[way].policy == policy)
+            return &set[way];
+    }
+    return NULL;
+}
+
+
+bool frame_cache_unchanged(const frame_cache_entry_t* entry, const can_frame_t* frame)
+{
+    if (entry->dlc != frame->dlc)
+        return false;
+    // Remote frames carry no payload
+    if (frame->flags & CAN_FRAME_FLAG_REMOTE)
+        return true;
+    for (uint8_t i=0; i<frame->dlc; i++) {
+        if (entry->data[i] != frame->data[i])
+            return false;
+    }
+    return true;
+}
+
+
+void frame_cache_store(frame_cache_entry_t* entry, const can_frame_t* frame)
+{
+    entry->dlc = frame->dlc;
+    if (!(frame->flags & CAN_FRAME_FLAG_REMOTE)) {
+        for (uint8_t i=0; i<frame->dlc; i++)
+            entry->data[i] = frame->data[i];
+    }
+    entry->repeats = 0;
+}
+
+
+uint32_t frame_cache_get_evictions(void)
+{
+    return evictions;
+}
+
+
+void frame_cache_expire(uint8_t policy, uint32_t now)
+{
+    for (uint8_t i=0; i<FRAME_CACHE_SETS; i++) {
+        for (uint8_t way=0; way<2; way++) {
+            frame_cache_entry_t* entry = &cache[i][way];
+            if (entry->key != 0 && entry->policy == policy && now - entry->time >= 0x80000000)
+                entry->key = 0;
+        }
+    }
+}
+
+
+void frame_cache_clear(void)
+{
+    for (uint8_t i=0; i<FRAME_CACHE_SETS; i++) {
+        cache[i][0].key = 0;
+        cache[i][1].key = 0;
+    }
+}
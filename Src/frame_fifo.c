@@ -0,0 +1,103 @@
+
+#include "frame_fifo.h"
+
+
+/**
+ * Returns the index following the given one, wrapping around at the end of the buffer
+ *
+ * Avoids the modulo operator, as the Cortex-M0 has no hardware divider.
+ */
+static inline uint16_t frame_fifo_next_index(frame_fifo_t* fifo, uint16_t index)
+{
+    index++;
+    if (index >= fifo->size)
+        index = 0;
+    return index;
+}
+
+
+void frame_fifo_init(frame_fifo_t* fifo, can_frame_t* buffer, uint16_t size)
+{
+    fifo->buffer = buffer;
+    fifo->size = size;
+
+    // Reset frame indices
+    fifo->push_index = 0;
+    fifo->pop_index = 0;
+}
+
+
+bool frame_fifo_is_empty(frame_fifo_t* fifo)
+{
+    return (fifo->pop_index == fifo->push_index);
+}
+
+
+bool frame_fifo_has_room(frame_fifo_t* fifo)
+{
+    // The FIFO is full, when storing one more frame would make the push_index catch up with the pop_index.
+    return (frame_fifo_next_index(fifo, fifo->push_index) != fifo->pop_index);
+}
+
+
+uint16_t frame_fifo_get_length(frame_fifo_t* fifo)
+{
+    uint16_t push_index = fifo->push_index;
+    uint16_t pop_index = fifo->pop_index;
+
+    if (push_index < pop_index)
+    {
+        return (push_index + fifo->size) - pop_index;
+    }
+    return push_index - pop_index;
+}
+
+
+bool frame_fifo_push(frame_fifo_t* fifo, const can_frame_t* frame)
+{
+    if (!frame_fifo_has_room(fifo))
+        // There is no free slot in the buffer.
+        return false;
+
+    uint16_t push_index = fifo->push_index;
+    fifo->buffer[push_index] = *frame;
+
+    // Publish the frame only after it has been written completely
+    __DMB();
+    fifo->push_index = frame_fifo_next_index(fifo, push_index);
+    return true;
+}
+
+
+can_frame_t* frame_fifo_peek(frame_fifo_t* fifo)
+{
+    if (frame_fifo_is_empty(fifo))
+        return 0;
+
+    // Don't read the frame before the producer's push_index update has been observed
+    __DMB();
+    return &fifo->buffer[fifo->pop_index];
+}
+
+
+void frame_fifo_commit_pop(frame_fifo_t* fifo)
+{
+    if (frame_fifo_is_empty(fifo))
+        return;
+
+    // Release the slot to the producer only after the frame has been read completely
+    __DMB();
+    fifo->pop_index = frame_fifo_next_index(fifo, fifo->pop_index);
+}
+
+
+bool frame_fifo_pop(frame_fifo_t* fifo, can_frame_t* frame)
+{
+    can_frame_t* oldest = frame_fifo_peek(fifo);
+    if (oldest == 0)
+        return false;
+
+    *frame = *oldest;
+    frame_fifo_commit_pop(fifo);
+    return true;
+}
@@ -0,0 +1,144 @@
+
+#include "frame_heap.h"
+
+
+uint32_t can_arbitration_key(const can_frame_t* frame)
+{
+    /*
+     * Arbitration field on the bus, most significant bit first:
+     *
+     *  standard: ID[10:0] RTR IDE=0
+     *  extended: ID[28:18] SRR=1 IDE=1 ID[17:0] RTR
+     *
+     * The key replicates this sequence, padded with zeros:
+     *
+     *  bit 31..21: ID[10:0] resp. ID[28:18]
+     *  bit 20:     RTR resp. SRR
+     *  bit 19:     IDE
+     *  bit 18..1:  zero resp. ID[17:0]
+     *  bit 0:      zero resp. RTR
+     */
+    uint32_t remote = (frame->flags & CAN_FRAME_FLAG_REMOTE) ? 1 : 0;
+
+    if (frame->flags & CAN_FRAME_FLAG_EXTENDED)
+        return ((frame->id >> 18) << 21)
+             | (1 << 20)
+             | (1 << 19)
+             | ((frame->id & 0x3FFFF) << 1)
+             | remote;
+
+    return (frame->id << 21) | (remote << 20);
+}
+
+
+/**
+ * Returns whether frame a must be transmitted before frame b
+ */
+static inline bool frame_heap_precedes(const can_frame_t* a, const can_frame_t* b)
+{
+    uint32_t key_a = can_arbitration_key(a);
+    uint32_t key_b = can_arbitration_key(b);
+
+    if (key_a != key_b)
+        return (key_a < key_b);
+
+    // Same identifier: Keep the order, in which the frames were pushed (wrap-around safe)
+    return ((int16_t) (a->timestamp - b->timestamp) < 0);
+}
+
+
+static inline void frame_heap_swap(can_frame_t* a, can_frame_t* b)
+{
+    can_frame_t tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+
+void frame_heap_init(frame_heap_t* heap, can_frame_t* buffer, uint16_t size)
+{
+    heap->buffer = buffer;
+    heap->size = size;
+    heap->length = 0;
+    heap->sequence = 0;
+}
+
+
+bool frame_heap_is_empty(frame_heap_t* heap)
+{
+    return (heap->length == 0);
+}
+
+
+uint16_t frame_heap_get_length(frame_heap_t* heap)
+{
+    return heap->length;
+}
+
+
+bool frame_heap_requeue(frame_heap_t* heap, const can_frame_t* frame)
+{
+    if (heap->length >= heap->size)
+        // There is no free slot in the buffer.
+        return false;
+
+    // Append the frame and let it rise to its position
+    uint16_t index = heap->length++;
+    heap->buffer[index] = *frame;
+
+    while (index > 0)
+    {
+        uint16_t parent = (index - 1) >> 1;
+        if (!frame_heap_precedes(&heap->buffer[index], &heap->buffer[parent]))
+            break;
+        frame_heap_swap(&heap->buffer[index], &heap->buffer[parent]);
+        index = parent;
+    }
+    return true;
+}
+
+
+bool frame_heap_push(frame_heap_t* heap, const can_frame_t* frame)
+{
+    can_frame_t numbered = *frame;
+    numbered.timestamp = heap->sequence;
+
+    if (!frame_heap_requeue(heap, &numbered))
+        return false;
+
+    heap->sequence++;
+    return true;
+}
+
+
+can_frame_t* frame_heap_peek(frame_heap_t* heap)
+{
+    if (heap->length == 0)
+        return 0;
+    return &heap->buffer[0];
+}
+
+
+void frame_heap_remove_top(frame_heap_t* heap)
+{
+    if (heap->length == 0)
+        return;
+
+    // Move the last frame to the top and let it sink to its position
+    uint16_t length = --heap->length;
+    heap->buffer[0] = heap->buffer[length];
+
+    uint16_t index = 0;
+    while (true)
+    {
+        uint16_t child = (index << 1) + 1;
+        if (child >= length)
+            break;
+        if ((child + 1 < length) && frame_heap_precedes(&heap->buffer[child + 1], &heap->buffer[child]))
+            child++;
+        if (!frame_heap_precedes(&heap->buffer[child], &heap->buffer[index]))
+            break;
+        frame_heap_swap(&heap->buffer[index], &heap->buffer[child]);
+        index = child;
+    }
+}
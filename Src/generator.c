@@ -0,0 +1,325 @@
+/**
+ * @file
+ * @brief Bus load generator
+ *
+ * Generates frames in firmware and loads them straight into the transmit mailboxes,
+ * either paced by the timebase to a frame rate or bus load,
+ * or as fast as the bus permits, refilled from the CAN interrupt.
+ * The timebase and the CAN interrupt run at the same priority,
+ * so the generator state is never accessed concurrently by them.
+ */
+
+#include "generator.h"
+#include "platform.h"
+#include "config.h"
+#include "timebase.h"
+#include <error.h>
+
+
+/*
+ * Configuration
+ */
+static enum generator_pattern id_pattern = GENERATOR_PATTERN_INCREMENT;
+static bool id_extended = false;
+static uint32_t id_min = 0;
+static uint32_t id_max = 0x7FF;
+static uint8_t dlc_min = 8;
+static uint8_t dlc_max = 8;
+static enum generator_pattern payload_pattern = GENERATOR_PATTERN_INCREMENT;
+static uint8_t payload[8];
+static uint32_t rate = 0;
+static uint8_t load = 0;
+
+/*
+ * State
+ */
+static volatile bool running = false;
+
+/** Frame generated, but not yet loaded into a mailbox */
+static can_frame_t frame;
+static volatile bool pending = false;
+
+static uint32_t next_id;
+static uint32_t random_state = 0x2545F491;
+
+/** Pacing: time of the next frame and interval per frame resp. per bit in 1/65536 us */
+static uint32_t due;
+static uint64_t interval_per_frame;
+static uint32_t interval_per_bit;
+static uint32_t interval_fraction;
+
+/** Statistics */
+static uint32_t start_time;
+static uint32_t stop_time;
+static volatile uint32_t frames;
+static can_tx_statistics_t start_statistics;
+
+
+int8_t generator_set_id(enum generator_pattern pattern, bool extended, uint32_t min, uint32_t max)
+{
+    if (running)
+        return ERROR_GENERATOR_RUNNING;
+    if (pattern > GENERATOR_PATTERN_RANDOM || min > max || max > (extended ? 0x1FFFFFFF : 0x7FF))
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    id_pattern = pattern;
+    id_extended = extended;
+    id_min = min;
+    id_max = max;
+    return SUCCESS;
+}
+
+
+int8_t generator_set_dlc(uint8_t min, uint8_t max)
+{
+    if (running)
+        return ERROR_GENERATOR_RUNNING;
+    if (min > max || max > 8)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    dlc_min = min;
+    dlc_max = max;
+    return SUCCESS;
+}
+
+
+int8_t generator_set_payload(enum generator_pattern pattern, const uint8_t data[8])
+{
+    if (running)
+        return ERROR_GENERATOR_RUNNING;
+    if (pattern > GENERATOR_PATTERN_RANDOM)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    payload_pattern = pattern;
+    for (uint8_t i=0; i<8; i++)
+        payload[i] = data[i];
+    return SUCCESS;
+}
+
+
+int8_t generator_set_rate(uint32_t frames_per_second)
+{
+    if (running)
+        return ERROR_GENERATOR_RUNNING;
+    if (frames_per_second > 1000000)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    rate = frames_per_second;
+    load = 0;
+    return SUCCESS;
+}
+
+
+int8_t generator_set_load(uint8_t percent)
+{
+    if (running)
+        return ERROR_GENERATOR_RUNNING;
+    if (percent == 0 || percent > 100)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    load = percent;
+    rate = 0;
+    return SUCCESS;
+}
+
+
+/**
+ * Returns a pseudo-random number (xorshift32)
+ */
+static inline uint32_t generator_random(void)
+{
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random_state = x;
+    return x;
+}
+
+
+/**
+ * Generates the next frame and marks it pending
+ */
+static void generator_next_frame(void)
+{
+    switch (id_pattern) {
+    case GENERATOR_PATTERN_FIXED:
+        frame.id = id_min;
+        break;
+    case GENERATOR_PATTERN_INCREMENT:
+        frame.id = next_id;
+        next_id = (next_id >= id_max) ? id_min : next_id + 1;
+        break;
+    default:
+        frame.id = id_min + generator_random() % (id_max - id_min + 1);
+        break;
+    }
+    frame.flags = id_extended ? CAN_FRAME_FLAG_EXTENDED : 0;
+
+    frame.dlc = dlc_min;
+    if (dlc_max > dlc_min)
+        frame.dlc += generator_random() % (dlc_max - dlc_min + 1);
+
+    switch (payload_pattern) {
+    case GENERATOR_PATTERN_FIXED:
+        for (uint8_t i=0; i<8; i++)
+            frame.data[i] = payload[i];
+        break;
+    case GENERATOR_PATTERN_INCREMENT:
+        for (uint8_t i=0; i<8; i++)
+            frame.data[i] = payload[i];
+        // Increment the little-endian counter
+        for (uint8_t i=0; i<8; i++)
+            if (++payload[i] != 0)
+                break;
+        break;
+    default: {
+        uint32_t low = generator_random();
+        uint32_t high = generator_random();
+        for (uint8_t i=0; i<4; i++) {
+            frame.data[i] = low >> (8*i);
+            frame.data[i+4] = high >> (8*i);
+        }
+        break;
+    }
+    }
+
+    pending = true;
+}
+
+
+/**
+ * Loads the pending frame into an empty transmit mailbox
+ *
+ * @return false, if all mailboxes are occupied
+ */
+static bool generator_load(void)
+{
+    if (!can_transmit_immediately(&frame))
+        return false;
+    pending = false;
+    frames++;
+    return true;
+}
+
+
+/**
+ * Returns the time in microseconds until the frame after the current one is due
+ */
+static uint32_t generator_interval(void)
+{
+    /*
+     * Nominal frame length in bits, including the interframe space:
+     *  standard: SOF, ID, RTR, IDE, r0, DLC, CRC, ACK, EOF, IFS: 47 bits + data
+     *  extended: additionally SRR, IDE, 18 bit ID extension, r1: 67 bits + data
+     */
+    uint32_t bits = (id_extended ? 67 : 47) + 8 * frame.dlc;
+
+    // Sum up the fractions of microseconds, so that the average rate is exact.
+    uint64_t interval = interval_per_frame + (uint64_t) bits * interval_per_bit + interval_fraction;
+    interval_fraction = interval & 0xFFFF;
+    return interval >> 16;
+}
+
+
+static inline bool generator_is_paced(void)
+{
+    return (rate != 0 || load != 0);
+}
+
+
+void generator_start(void)
+{
+    // Compute pacing in 1/65536 microseconds
+    interval_per_frame = 0;
+    interval_per_bit = 0;
+    interval_fraction = 0;
+    if (rate != 0)
+        interval_per_frame = ((uint64_t) 1000000 << 16) / rate;
+    if (load != 0)
+        interval_per_bit = ((uint64_t) 100 * 1000000 << 16) / ((uint64_t) load * can_get_bitrate());
+
+    can_get_tx_statistics(&start_statistics);
+
+    enter_critical();
+    next_id = id_min;
+    pending = false;
+    frames = 0;
+    start_time = now_us();
+    due = start_time;
+    running = true;
+
+    if (generator_is_paced())
+        timebase_set_alarm(TIMEBASE_ALARM_GENERATOR, due);
+    else
+        // Let the CAN interrupt fill the mailboxes
+        HAL_NVIC_SetPendingIRQ(CEC_CAN_IRQn);
+    exit_critical();
+}
+
+
+void generator_stop(void)
+{
+    enter_critical();
+    if (running)
+        stop_time = now_us();
+    running = false;
+    pending = false;
+    timebase_cancel_alarm(TIMEBASE_ALARM_GENERATOR);
+    exit_critical();
+}
+
+
+void generator_get_status(generator_status_t* status)
+{
+    can_tx_statistics_t statistics;
+    uint32_t elapsed = (running ? now_us() : stop_time) - start_time;
+
+    can_get_tx_statistics(&statistics);
+
+    status->running = running;
+    status->frames = frames;
+    status->rate = (elapsed > 0) ? ((uint64_t) frames * 1000000 / elapsed) : 0;
+    status->arbitration_lost = statistics.arbitration_lost - start_statistics.arbitration_lost;
+    status->errors = statistics.errors - start_statistics.errors;
+}
+
+
+void generator_load_pending(void)
+{
+    if (!running)
+        return;
+
+    if (pending && !generator_load())
+        return;
+
+    if (generator_is_paced()) {
+        // Continue with the next frame, which may already be due
+        timebase_set_alarm(TIMEBASE_ALARM_GENERATOR, due);
+    } else {
+        // Keep all mailboxes filled
+        do {
+            generator_next_frame();
+        } while (generator_load());
+    }
+}
+
+
+void generator_alarm(void)
+{
+    uint32_t now = now_us();
+
+    while (running && !pending && timebase_is_due(due, now))
+    {
+        generator_next_frame();
+        due += generator_interval();
+        // Don't catch up on a backlog, after the bus was saturated
+        if (timebase_is_due(due, now))
+            due = now;
+        generator_load();
+    }
+
+    // With a frame pending, the CAN interrupt continues, when a mailbox becomes empty.
+    if (running && !pending)
+        timebase_set_alarm(TIMEBASE_ALARM_GENERATOR, due);
+}
@@ -4,9 +4,10 @@
  */
 
 #include "led.h"
+#include "timebase.h"
 
 /**
- * Tick count, when activity LED was last switched on
+ * Time in microseconds, when the LED was last switched on
  */
 #ifdef LED_ACTIVITY_ENABLED
 static uint32_t activity_led_last_on = 0xFF;
@@ -66,19 +67,19 @@ void led_on(led_index_t led)
     // Make sure the LED has been off for at least LED_DURATION before turning on again.
     // This prevents a solid status LED on a busy canbus.
     if ((led == LED_ACTIVITY)
-     && (HAL_GetTick() - activity_led_last_on > 2*LED_ON_DURATION))
+     && (now_us() - activity_led_last_on > 2*LED_ON_DURATION))
     {
         HAL_GPIO_WritePin(LED_ACTIVITY_PORT, LED_ACTIVITY_PIN, GPIO_PIN_RESET);
-        activity_led_last_on = HAL_GetTick();
+        activity_led_last_on = now_us();
     }
     #endif
 
     #ifdef LED_ERROR_ENABLED
     if ((led == LED_ERROR)
-     && (HAL_GetTick() - error_led_last_on > 2*LED_ON_DURATION))
+     && (now_us() - error_led_last_on > 2*LED_ON_DURATION))
     {
         HAL_GPIO_WritePin(LED_ERROR_PORT, LED_ERROR_PIN, GPIO_PIN_SET);
-        error_led_last_on = HAL_GetTick();
+        error_led_last_on = now_us();
     }
     #endif
 }
@@ -115,7 +116,7 @@ void led_process()
 {
     #ifdef LED_ACTIVITY_ENABLED
     if ((HAL_GPIO_ReadPin(LED_ACTIVITY_PORT, LED_ACTIVITY_PIN) == GPIO_PIN_RESET)
-     && (HAL_GetTick() - activity_led_last_on > LED_ON_DURATION))
+     && (now_us() - activity_led_last_on > LED_ON_DURATION))
     {
         led_off(LED_ACTIVITY);
     }
@@ -123,7 +124,7 @@ void led_process()
 
     #ifdef LED_ERROR_ENABLED
     if ((HAL_GPIO_ReadPin(LED_ERROR_PORT, LED_ERROR_PIN) == GPIO_PIN_SET)
-     && (HAL_GetTick() - error_led_last_on > LED_ON_DURATION))
+     && (now_us() - error_led_last_on > LED_ON_DURATION))
     {
         led_off(LED_ERROR);
     }
@@ -7,7 +7,10 @@
 #include "platform.h"
 #include "clock.h"
 #include "can.h"
+#include "slcan.h"
 #include "led.h"
+#include "filter.h"
+#include "timebase.h"
 
 #include "usb_device.h"
 #include "usart.h"
@@ -22,6 +25,7 @@ int main()
 
     /* Initialize all configured peripherals */
     MX_GPIO_Init();
+    timebase_init();
     can_init();
     led_init();
     #ifdef PC_INTERFACE_USB
@@ -35,6 +39,8 @@ int main()
     for (;;)
     {
         can_process();
+        slcan_process();
         led_process();
+        filter_process();
     }
 }
@@ -0,0 +1,164 @@
+/**
+ * @file
+ * @brief Playback of a frame schedule with device-side timing
+ *
+ * The PC streams records of (time, frame) ahead of time.
+ * Each frame is loaded into a transmit mailbox from the timebase interrupt,
+ * as soon as its time has come, so the inter-frame gaps
+ * do not depend on USB or host scheduling.
+ *
+ * The record queue is a single-producer/single-consumer ring like @ref frame_fifo_t:
+ * Records are pushed by the interrupt receiving commands
+ * and popped by the timebase and CAN interrupt, which run at the same priority
+ * and thereby act as one consumer.
+ */
+
+#include "playback.h"
+#include "platform.h"
+#include "config.h"
+#include "timebase.h"
+#include <error.h>
+
+
+/**
+ * Frame with its transmission time
+ */
+typedef struct {
+    uint32_t time;
+    can_frame_t frame;
+} playback_record_t;
+
+
+static playback_record_t playback_queue[PLAYBACK_QUEUE_LENGTH];
+static volatile uint16_t push_index = 0;
+static volatile uint16_t pop_index = 0;
+
+/**
+ * Playback state, written only while the timebase interrupt is blocked
+ */
+static volatile bool running = false;
+static uint32_t start_time;
+
+static volatile uint32_t underruns = 0;
+static volatile uint32_t late = 0;
+
+
+static inline uint16_t playback_next_index(uint16_t index)
+{
+    index++;
+    if (index >= PLAYBACK_QUEUE_LENGTH)
+        index = 0;
+    return index;
+}
+
+
+static inline bool playback_is_empty(void)
+{
+    return (push_index == pop_index);
+}
+
+
+int8_t playback_push(uint32_t time, const can_frame_t* frame)
+{
+    uint16_t index = push_index;
+    uint16_t next = playback_next_index(index);
+    if (next == pop_index)
+        return ERROR_TX_FIFO_OVERRUN;
+
+    // The PC did not keep the queue filled.
+    if (running && playback_is_empty() && timebase_is_due(start_time + time, now_us()))
+        underruns++;
+
+    playback_queue[index].time = time;
+    playback_queue[index].frame = *frame;
+
+    // Publish the record only after it has been written completely
+    __DMB();
+    push_index = next;
+
+    // Let the interrupt check, whether the new record is due
+    if (running)
+        timebase_trigger_alarm(TIMEBASE_ALARM_PLAYBACK);
+    return SUCCESS;
+}
+
+
+void playback_start(void)
+{
+    enter_critical();
+    underruns = 0;
+    late = 0;
+    start_time = now_us();
+    running = true;
+    timebase_set_alarm(TIMEBASE_ALARM_PLAYBACK, start_time);
+    exit_critical();
+}
+
+
+void playback_stop(void)
+{
+    enter_critical();
+    running = false;
+    timebase_cancel_alarm(TIMEBASE_ALARM_PLAYBACK);
+    // Both interrupts using the queue are blocked, so the consumer's index may be written here.
+    pop_index = push_index;
+    exit_critical();
+}
+
+
+void playback_get_status(playback_status_t* status)
+{
+    uint16_t push = push_index;
+    uint16_t pop = pop_index;
+
+    status->running = running;
+    status->queued = (push >= pop) ? (push - pop) : (push + PLAYBACK_QUEUE_LENGTH - pop);
+    status->underruns = underruns;
+    status->late = late;
+}
+
+
+/**
+ * Loads due records into the transmit mailboxes, oldest first,
+ * until the next record is not yet due, no mailbox is empty or the queue ran empty
+ */
+static void playback_release(void)
+{
+    while (running && !playback_is_empty())
+    {
+        // Don't read the record before the producer's push_index update has been observed
+        __DMB();
+        playback_record_t* record = &playback_queue[pop_index];
+        uint32_t due = start_time + record->time;
+        uint32_t now = now_us();
+
+        if (!timebase_is_due(due, now))
+        {
+            timebase_set_alarm(TIMEBASE_ALARM_PLAYBACK, due);
+            return;
+        }
+
+        if (!can_transmit_immediately(&record->frame))
+            // The CAN interrupt continues, when a mailbox becomes empty.
+            return;
+
+        if (now - due > PLAYBACK_LATE_THRESHOLD)
+            late++;
+
+        // Release the slot to the producer only after the record has been read completely
+        __DMB();
+        pop_index = playback_next_index(pop_index);
+    }
+}
+
+
+void playback_load_pending(void)
+{
+    playback_release();
+}
+
+
+void playback_alarm(void)
+{
+    playback_release();
+}
@@ -5,36 +5,79 @@
 
 #include "stm32f0xx_hal.h"
 #include "can.h"
-#include "fifo.h"
 #include "slcan.h"
+#include "platform.h"
+#include "config.h"
+#include "fifo.h"
+#include "cyclic.h"
+#include "playback.h"
+#include "generator.h"
+#include "timebase.h"
+#include "binary.h"
+#include "filter.h"
+#include "usbd_cdc_if.h"
+#include "usart.h"
 #include <error.h>
 
 
-int8_t slcan_parse_frame(CanRxMsgTypeDef* frame, uint8_t* buf) {
+/**
+ * Replies to commands, waiting to be sent to the PC
+ *
+ * Pushed to by the interrupt receiving commands, popped by the main loop.
+ */
+static uint8_t reply_buffer[SLCAN_REPLY_BUFFER_SIZE];
+static fifo_t reply_fifo = {
+    .buffer = reply_buffer,
+    .size = SLCAN_REPLY_BUFFER_SIZE,
+};
+
+/**
+ * Timestamp appended to received frames
+ */
+static enum slcan_timestamp_mode timestamp_mode = SLCAN_TIMESTAMP_OFF;
+
+/**
+ * Protocol selected by the PC, applied to the input right away
+ * and to the output by the main loop, see @ref CANTACT_SET_BINARY_MODE
+ */
+static volatile enum slcan_protocol input_protocol = SLCAN_PROTOCOL_TEXT;
+static enum slcan_protocol output_protocol = SLCAN_PROTOCOL_TEXT;
+
+/**
+ * Received frame converted for the PC, but not yet accepted by the interface to the PC;
+ * kept, as the compression must convert each frame exactly once
+ */
+static uint8_t frame_buffer[SLCAN_MTU];
+static uint8_t frame_length = 0;
+
+static void int2hex(uint32_t value, uint8_t digits, uint8_t* buf);
+
+
+int8_t slcan_parse_frame(can_frame_t* frame, uint8_t* buf) {
     uint8_t i = 0;
     uint8_t id_len, j;
     uint32_t tmp;
 
-    for (j=0; j < SLCAN_MTU; j++) {
-        buf[j] = '\0';
-    }
+    if (output_protocol == SLCAN_PROTOCOL_BINARY)
+        return binary_encode_frame(frame, buf);
+    if (output_protocol == SLCAN_PROTOCOL_COMPRESSED)
+        return binary_encode_compressed_frame(frame, buf);
 
     // add character for frame type
-    if (frame->RTR == CAN_RTR_DATA) {
-        buf[i] = 't';
-    } else if (frame->RTR == CAN_RTR_REMOTE) {
+    if (frame->flags & CAN_FRAME_FLAG_REMOTE) {
         buf[i] = 'r';
+    } else {
+        buf[i] = 't';
     }
 
     // assume standard identifier
     id_len = SLCAN_STD_ID_LEN;
-    tmp = frame->StdId;
+    tmp = frame->id;
     // check if extended
-    if (frame->IDE == CAN_ID_EXT) {
+    if (frame->flags & CAN_FRAME_FLAG_EXTENDED) {
         // convert first char to upper case for extended frame
         buf[i] -= 32;
         id_len = SLCAN_EXT_ID_LEN;
-        tmp = frame->ExtId;
     }
     i++;
 
@@ -47,12 +90,12 @@ int8_t slcan_parse_frame(CanRxMsgTypeDef* frame, uint8_t* buf) {
     }
 
     // add DLC to buffer
-    buf[i++] = frame->DLC;
+    buf[i++] = frame->dlc;
 
     // add data bytes
-    for (j = 0; j < frame->DLC; j++) {
-        buf[i++] = (frame->Data[j] >> 4);
-        buf[i++] = (frame->Data[j] & 0x0F);
+    for (j = 0; j < frame->dlc; j++) {
+        buf[i++] = (frame->data[j] >> 4);
+        buf[i++] = (frame->data[j] & 0x0F);
     }
 
     // convert to ASCII (2nd character to end)
@@ -64,6 +107,21 @@ int8_t slcan_parse_frame(CanRxMsgTypeDef* frame, uint8_t* buf) {
         }
     }
 
+    // add timestamp
+    if (timestamp_mode == SLCAN_TIMESTAMP_MILLISECONDS) {
+        // Extend the timestamp, so that the value doesn't jump, when the timebase wraps around.
+        int2hex((timebase_extend(frame->timestamp) / 1000) % 60000, 4, &buf[i]);
+        i += 4;
+    } else if (timestamp_mode == SLCAN_TIMESTAMP_MICROSECONDS) {
+        int2hex(frame->timestamp, 8, &buf[i]);
+        i += 8;
+    } else if (timestamp_mode == SLCAN_TIMESTAMP_HOST) {
+        uint64_t time = timebase_to_host(timebase_extend(frame->timestamp));
+        int2hex(time >> 32, 8, &buf[i]);
+        int2hex(time, 8, &buf[i + 8]);
+        i += 16;
+    }
+
     // add carriage return (slcan EOL)
     buf[i++] = SLCAN_COMMAND_TERMINATOR;
 
@@ -89,6 +147,511 @@ inline uint8_t hex2int(uint8_t c) {
 }
 
 
+/**
+ * Returns whether a character is a hexadecimal digit
+ */
+static inline bool is_hex(uint8_t c) {
+    return (c >= '0' && c <= '9')
+        || (c >= 'a' && c <= 'f')
+        || (c >= 'A' && c <= 'F');
+}
+
+
+/**
+ * Parses a fixed number of hexadecimal digits
+ *
+ * @param buf       First digit
+ * @param digits    Number of digits to parse, at most 8
+ * @param value     Set to the parsed value
+ * @return false, if a character is not a hexadecimal digit
+ */
+static bool parse_hex(uint8_t* buf, uint8_t digits, uint32_t* value) {
+    *value = 0;
+    for (uint8_t i=0; i<digits; i++) {
+        if (!is_hex(buf[i]))
+            return false;
+        *value = (*value << 4) | hex2int(buf[i]);
+    }
+    return true;
+}
+
+
+/**
+ * Writes a value as a fixed number of uppercase hexadecimal digits
+ */
+static void int2hex(uint32_t value, uint8_t digits, uint8_t* buf) {
+    for (uint8_t i=digits; i>0; i--) {
+        uint8_t nibble = value & 0xF;
+        buf[i-1] = (nibble < 0xA) ? (nibble + '0') : (nibble - 0xA + 'A');
+        value >>= 4;
+    }
+}
+
+
+/**
+ * Queues a reply to the PC; dropped, if the reply buffer is full
+ */
+static void slcan_reply(uint8_t* buf, uint8_t len) {
+    fifo_push_record(&reply_fifo, buf, len);
+}
+
+
+/**
+ * Parses an entry number of the cyclic scheduler: one hexadecimal digit, or '*' if permitted
+ */
+static bool parse_cyclic_entry(uint8_t c, bool all_permitted, uint8_t* index) {
+    uint32_t value;
+    if (all_permitted && c == '*') {
+        *index = CYCLIC_ALL_ENTRIES;
+        return true;
+    }
+    if (!parse_hex(&c, 1, &value))
+        return false;
+    *index = value;
+    return true;
+}
+
+
+/**
+ * Parses a payload byte index of the cyclic scheduler: '0' to '7', or '-' for none
+ */
+static bool parse_cyclic_byte(uint8_t c, uint8_t* index) {
+    if (c == '-') {
+        *index = CYCLIC_BYTE_NONE;
+        return true;
+    }
+    if (c < '0' || c > '7')
+        return false;
+    *index = c - '0';
+    return true;
+}
+
+
+/**
+ * Parses a command for the cyclic scheduler, see @ref CANTACT_CYCLIC
+ */
+static int8_t slcan_parse_cyclic_command(uint8_t* buf, uint8_t len) {
+    uint8_t index;
+
+    if (len < 3)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    switch (buf[1]) {
+    case 'f': {
+        // cfS<transmit command>: set the frame of an entry
+        can_frame_t frame;
+        if (len < 4 || !parse_cyclic_entry(buf[2], false, &index)
+         || !slcan_parse_transmit_command(&buf[3], len - 3, &frame))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return cyclic_set_frame(index, &frame);
+    }
+
+    case 'p': {
+        // cpSPPPPPPPPHHHHHHHH: set period and phase of an entry in microseconds
+        uint32_t period, phase;
+        if (len != 20 || !parse_cyclic_entry(buf[2], false, &index)
+         || !parse_hex(&buf[3], 8, &period) || !parse_hex(&buf[11], 8, &phase))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return cyclic_set_timing(index, period, phase);
+    }
+
+    case 'b': {
+        // cbSKX: set counter and checksum byte of an entry
+        uint8_t counter, checksum;
+        if (len != 6 || !parse_cyclic_entry(buf[2], false, &index)
+         || !parse_cyclic_byte(buf[3], &counter) || !parse_cyclic_byte(buf[4], &checksum))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return cyclic_set_update_bytes(index, counter, checksum);
+    }
+
+    case 's':
+        // csS or cs*: start one or all entries
+        if (len != 4 || !parse_cyclic_entry(buf[2], true, &index))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        if (can_get_bus_state() != ON_BUS)
+            return ERROR_CAN_NOT_ON_BUS;
+        return cyclic_start(index);
+
+    case 'x':
+        // cxS or cx*: stop one or all entries
+        if (len != 4 || !parse_cyclic_entry(buf[2], true, &index))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        cyclic_stop(index);
+        return SUCCESS;
+
+    case 'c':
+        // cc: remove all entries
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        cyclic_clear();
+        return SUCCESS;
+    }
+
+    return ERROR_SLCAN_COMMAND_NOT_RECOGNIZED;
+}
+
+
+/**
+ * Parses a command for the timed playback, see @ref CANTACT_PLAYBACK
+ */
+static int8_t slcan_parse_playback_command(uint8_t* buf, uint8_t len) {
+
+    if (len < 3)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    if (is_hex(buf[1])) {
+        // qTTTTTTTT<transmit command>: queue a frame for transmission at time T
+        uint32_t time;
+        can_frame_t frame;
+        if (len < 10 || !parse_hex(&buf[1], 8, &time)
+         || !slcan_parse_transmit_command(&buf[9], len - 9, &frame))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return playback_push(time, &frame);
+    }
+
+    if (len != 3)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    switch (buf[1]) {
+    case 's':
+        // qs: start playback
+        if (can_get_bus_state() != ON_BUS)
+            return ERROR_CAN_NOT_ON_BUS;
+        playback_start();
+        return SUCCESS;
+
+    case 'x':
+        // qx: stop playback, discard queued frames
+        playback_stop();
+        return SUCCESS;
+
+    case 'r': {
+        // qr: report status as qRNNNNUUUUUUUULLLLLLLL
+        playback_status_t status;
+        uint8_t reply[23];
+        playback_get_status(&status);
+        reply[0] = CANTACT_PLAYBACK;
+        reply[1] = status.running ? '1' : '0';
+        int2hex(status.queued, 4, &reply[2]);
+        int2hex(status.underruns, 8, &reply[6]);
+        int2hex(status.late, 8, &reply[14]);
+        reply[22] = SLCAN_COMMAND_TERMINATOR;
+        slcan_reply(reply, sizeof(reply));
+        return SUCCESS;
+    }
+    }
+
+    return ERROR_SLCAN_COMMAND_NOT_RECOGNIZED;
+}
+
+
+/**
+ * Parses a command for the bus load generator, see @ref CANTACT_GENERATOR
+ */
+static int8_t slcan_parse_generator_command(uint8_t* buf, uint8_t len) {
+    uint32_t value;
+
+    if (len < 3)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    switch (buf[1]) {
+    case 'i': {
+        // giPEAAAAAAAABBBBBBBB: identifier pattern, frame type and range
+        uint32_t min, max;
+        if (len != 21 || buf[3] < '0' || buf[3] > '1'
+         || !parse_hex(&buf[2], 1, &value) || !parse_hex(&buf[4], 8, &min) || !parse_hex(&buf[12], 8, &max))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return generator_set_id(value, buf[3] == '1', min, max);
+    }
+
+    case 'd': {
+        // gdLH: DLC range
+        uint32_t min, max;
+        if (len != 5 || !parse_hex(&buf[2], 1, &min) || !parse_hex(&buf[3], 1, &max))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return generator_set_dlc(min, max);
+    }
+
+    case 'p': {
+        // gpPDDDDDDDDDDDDDDDD: payload pattern and data
+        uint8_t data[8];
+        if (len != 20 || !parse_hex(&buf[2], 1, &value))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        for (uint8_t i=0; i<8; i++) {
+            uint32_t byte;
+            if (!parse_hex(&buf[3 + 2*i], 2, &byte))
+                return ERROR_SLCAN_INVALID_ARGUMENT;
+            data[i] = byte;
+        }
+        return generator_set_payload(value, data);
+    }
+
+    case 'f':
+        // gfRRRRRRRR: frame rate in frames per second, zero for back-to-back
+        if (len != 11 || !parse_hex(&buf[2], 8, &value))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return generator_set_rate(value);
+
+    case 'l':
+        // glLL: bus load in percent
+        if (len != 5 || !parse_hex(&buf[2], 2, &value))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return generator_set_load(value);
+
+    case 's':
+        // gs: start generating
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        if (can_get_bus_state() != ON_BUS)
+            return ERROR_CAN_NOT_ON_BUS;
+        generator_start();
+        return SUCCESS;
+
+    case 'x':
+        // gx: stop generating
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        generator_stop();
+        return SUCCESS;
+
+    case 'r': {
+        // gr: report status as gRFFFFFFFFAAAAAAAAEEEEEEEE
+        generator_status_t status;
+        uint8_t reply[27];
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        generator_get_status(&status);
+        reply[0] = CANTACT_GENERATOR;
+        reply[1] = status.running ? '1' : '0';
+        int2hex(status.rate, 8, &reply[2]);
+        int2hex(status.arbitration_lost, 8, &reply[10]);
+        int2hex(status.errors, 8, &reply[18]);
+        reply[26] = SLCAN_COMMAND_TERMINATOR;
+        slcan_reply(reply, sizeof(reply));
+        return SUCCESS;
+    }
+    }
+
+    return ERROR_SLCAN_COMMAND_NOT_RECOGNIZED;
+}
+
+
+/**
+ * Parses a command for the clock synchronization, see @ref CANTACT_CLOCK_SYNC
+ */
+static int8_t slcan_parse_clock_sync_command(uint8_t* buf, uint8_t len) {
+    // Device time of the last ping, to which the host clock settings refer
+    static uint64_t ping_time = 0;
+
+    if (len < 3)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    switch (buf[1]) {
+    case 'p': {
+        // ypHHHHHHHHHHHHHHHH: ping, reply with the host time and the device time
+        uint64_t now = now_us64();
+        uint8_t reply[34];
+        if (len != 19)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        for (uint8_t i=0; i<16; i++) {
+            if (!is_hex(buf[2 + i]))
+                return ERROR_SLCAN_INVALID_ARGUMENT;
+            reply[1 + i] = buf[2 + i];
+        }
+        ping_time = now;
+        reply[0] = CANTACT_CLOCK_SYNC;
+        int2hex(now >> 32, 8, &reply[17]);
+        int2hex(now, 8, &reply[25]);
+        reply[33] = SLCAN_COMMAND_TERMINATOR;
+        slcan_reply(reply, sizeof(reply));
+        return SUCCESS;
+    }
+
+    case 'c': {
+        // ycOOOOOOOOOOOOOOOORRRRRRRR: set offset and drift of the host clock
+        uint32_t high, low, drift;
+        if (len != 27 || !parse_hex(&buf[2], 8, &high) || !parse_hex(&buf[10], 8, &low)
+         || !parse_hex(&buf[18], 8, &drift))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        timebase_set_host_clock(ping_time, (int64_t) (((uint64_t) high << 32) | low), (int32_t) drift);
+        return SUCCESS;
+    }
+    }
+
+    return ERROR_SLCAN_COMMAND_NOT_RECOGNIZED;
+}
+
+
+/**
+ * Parses a command for the filter manager, see @ref CANTACT_FILTER
+ */
+static int8_t slcan_parse_filter_command(uint8_t* buf, uint8_t len) {
+
+    if (len < 3)
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    switch (buf[1]) {
+    case 'a':
+    case 'd': {
+        // aaEIIIIIIII[P], aaEFFFFFFFFLLLLLLLL[P]: add, adE...: delete
+        uint32_t first, last, policy = 0;
+        bool with_policy = (buf[1] == 'a') && (len == 13 || len == 21);
+        uint8_t digits = len - 4 - (with_policy ? 1 : 0);
+        if ((digits != 8 && digits != 16) || (buf[2] != '0' && buf[2] != '1') || !parse_hex(&buf[3], 8, &first))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        last = first;
+        if (digits == 16 && !parse_hex(&buf[11], 8, &last))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        if (with_policy && !parse_hex(&buf[3 + digits], 1, &policy))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        if (buf[1] == 'a')
+            return filter_add(buf[2] == '1', first, last, policy);
+        return filter_remove(buf[2] == '1', first, last);
+    }
+
+    case 'c':
+        // ac: accept all frames
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        filter_clear();
+        return SUCCESS;
+
+    case 'o':
+        // aoD: data frames only
+        if (len != 4 || (buf[2] != '0' && buf[2] != '1'))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        filter_set_data_only(buf[2] == '1');
+        return SUCCESS;
+
+    case 'r': {
+        // ar: report as aNNBBX
+        filter_status_t status;
+        uint8_t reply[7];
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        filter_get_status(&status);
+        reply[0] = CANTACT_FILTER;
+        int2hex(status.entries, 2, &reply[1]);
+        int2hex(status.banks, 2, &reply[3]);
+        reply[5] = status.exact ? '1' : '0';
+        reply[6] = SLCAN_COMMAND_TERMINATOR;
+        slcan_reply(reply, sizeof(reply));
+        return SUCCESS;
+    }
+
+    case 's':
+        if (len == 4) {
+            // asD: enable resp. disable the software stage
+            if (buf[2] != '0' && buf[2] != '1')
+                return ERROR_SLCAN_INVALID_ARGUMENT;
+            filter_software_enable(buf[2] == '1');
+            return SUCCESS;
+        }
+        if (len == 3) {
+            // as: report as asXNNDDDDDDDD
+            filter_status_t status;
+            uint8_t reply[14];
+            filter_get_status(&status);
+            reply[0] = CANTACT_FILTER;
+            reply[1] = 's';
+            reply[2] = status.software ? '1' : '0';
+            int2hex(status.software_extended, 2, &reply[3]);
+            int2hex(status.software_dropped, 8, &reply[5]);
+            reply[13] = SLCAN_COMMAND_TERMINATOR;
+            slcan_reply(reply, sizeof(reply));
+            return SUCCESS;
+        }
+        return ERROR_SLCAN_INVALID_ARGUMENT;
+
+    case 'i': {
+        // ai: report the frame cache as aiLLLLEEEEEEEEDDDDDDDD
+        filter_status_t status;
+        uint8_t reply[23];
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        filter_get_status(&status);
+        reply[0] = CANTACT_FILTER;
+        reply[1] = 'i';
+        int2hex(FRAME_CACHE_LENGTH, 4, &reply[2]);
+        int2hex(status.cache_evictions, 8, &reply[6]);
+        int2hex(status.held_dropped, 8, &reply[14]);
+        reply[22] = SLCAN_COMMAND_TERMINATOR;
+        slcan_reply(reply, sizeof(reply));
+        return SUCCESS;
+    }
+
+    case 'p': {
+        // apPAIIIIIIII: configure policy P
+        uint32_t index, action, interval = 0;
+        if ((len != 5 && len != 13) || !parse_hex(&buf[2], 1, &index) || !parse_hex(&buf[3], 1, &action))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        if (len == 13 && !parse_hex(&buf[4], 8, &interval))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        return filter_set_policy(index, action, interval);
+    }
+
+    case 'q': {
+        // aqP: report policy P as aqPAFFFFFFFF
+        filter_policy_status_t status;
+        uint32_t index;
+        uint8_t reply[13];
+        if (len != 4 || !parse_hex(&buf[2], 1, &index) || filter_get_policy(index, &status) != SUCCESS)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        reply[0] = CANTACT_FILTER;
+        reply[1] = 'q';
+        reply[2] = buf[2];
+        int2hex(status.action, 1, &reply[3]);
+        int2hex(status.frames, 8, &reply[4]);
+        reply[12] = SLCAN_COMMAND_TERMINATOR;
+        slcan_reply(reply, sizeof(reply));
+        return SUCCESS;
+    }
+
+    case 'e':
+        // ae: empty the software stage
+        if (len != 3)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        filter_software_clear();
+        return SUCCESS;
+
+    case 'b': {
+        // abOOHH...: write 1-8 bytes of the bitmap, starting at byte O
+        uint8_t bits[8];
+        uint8_t count = (len - 5) / 2;
+        uint32_t value;
+        if (len < 7 || len > 21 || (len & 1) == 0 || !parse_hex(&buf[2], 2, &value))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        uint8_t offset = value;
+        for (uint8_t i=0; i<count; i++) {
+            if (!parse_hex(&buf[4 + 2*i], 2, &value))
+                return ERROR_SLCAN_INVALID_ARGUMENT;
+            bits[i] = value;
+        }
+        return filter_software_set_bitmap(offset, bits, count);
+    }
+
+    case 'x': {
+        // axIIIIIIII...: add 1-4 extended identifiers
+        uint8_t count = (len - 3) / 8;
+        uint32_t id;
+        if (count < 1 || count > 4 || len != 3 + 8*count)
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        for (uint8_t i=0; i<count; i++) {
+            int8_t result;
+            if (!parse_hex(&buf[2 + 8*i], 8, &id))
+                return ERROR_SLCAN_INVALID_ARGUMENT;
+            result = filter_software_add_extended(id);
+            if (result != SUCCESS)
+                return result;
+        }
+        return SUCCESS;
+    }
+    }
+
+    return ERROR_SLCAN_COMMAND_NOT_RECOGNIZED;
+}
+
+
 int8_t slcan_parse_command(uint8_t* buf, uint8_t len) {
 
     static uint32_t current_filter_id = 0;
@@ -155,6 +718,7 @@ int8_t slcan_parse_command(uint8_t* buf, uint8_t len) {
             id += hex2int(buf[i]);
         }
         current_filter_id = id;
+        filter_clear();
         can_set_filter(current_filter_id, current_filter_mask);
         return SUCCESS;
 
@@ -171,15 +735,72 @@ int8_t slcan_parse_command(uint8_t* buf, uint8_t len) {
             mask += hex2int(buf[i]);
         }
         current_filter_mask = mask;
+        filter_clear();
         can_set_filter(current_filter_id, current_filter_mask);
         return SUCCESS;
 
+    } else if (buf[0] == SLCAN_SET_TIMESTAMPING) {
+
+        // Z0: off, Z1: milliseconds, Z2: microseconds, Z3: host time
+        if (len != 3 || buf[1] < '0' || buf[1] > '3')
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+
+        timestamp_mode = buf[1] - '0';
+        return SUCCESS;
+
+    } else if (buf[0] == CANTACT_SET_BINARY_MODE) {
+
+        // B0: SLCAN, B1: binary protocol, B2: compressed binary protocol
+        if (len != 3 || buf[1] < '0' || buf[1] > '2')
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+
+        if (buf[1] != '0' && input_protocol == SLCAN_PROTOCOL_TEXT)
+            binary_reset();
+        input_protocol = buf[1] - '0';
+        return SUCCESS;
+
+    } else if (buf[0] == CANTACT_SET_RX_OVERRUN_MODE) {
+
+        // o0: overwrite oldest frame, o1: discard newest frame when a hardware FIFO is full
+        if (len != 3 || (buf[1] != '0' && buf[1] != '1'))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+
+        can_set_rx_overrun_mode(buf[1] == '1');
+        return SUCCESS;
+
+    } else if (buf[0] == CANTACT_SET_TX_PRIORITY_MODE) {
+
+        // p0: transmit in queue order, p1: transmit by identifier priority
+        if (len != 3 || (buf[1] != '0' && buf[1] != '1'))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+
+        can_set_tx_priority_mode(buf[1] == '1');
+        return SUCCESS;
+
+    } else if (buf[0] == CANTACT_CYCLIC) {
+        return slcan_parse_cyclic_command(buf, len);
+
+    } else if (buf[0] == CANTACT_PLAYBACK) {
+        return slcan_parse_playback_command(buf, len);
+
+    } else if (buf[0] == CANTACT_GENERATOR) {
+        return slcan_parse_generator_command(buf, len);
+
+    } else if (buf[0] == CANTACT_FILTER) {
+        return slcan_parse_filter_command(buf, len);
+
+    } else if (buf[0] == CANTACT_CLOCK_SYNC) {
+        return slcan_parse_clock_sync_command(buf, len);
+
     } else if ((buf[0] == SLCAN_TRANSMIT_STANDARD)
             || (buf[0] == SLCAN_TRANSMIT_EXTENDED)
             || (buf[0] == SLCAN_TRANSMIT_REQUEST_STANDARD)
             || (buf[0] == SLCAN_TRANSMIT_REQUEST_EXTENDED)) {
-        extern fifo_t can_tx_fifo;
-        if (fifo_push(&can_tx_fifo, buf, len))
+        // Validate and convert the command right away, only the binary frame is queued.
+        can_frame_t frame;
+        if (!slcan_parse_transmit_command(buf, len, &frame))
+            return ERROR_SLCAN_INVALID_ARGUMENT;
+        if (can_send(&frame))
             // ok
             return SUCCESS;
         // error
@@ -190,7 +811,94 @@ int8_t slcan_parse_command(uint8_t* buf, uint8_t len) {
 }
 
 
-bool slcan_parse_transmit_command(uint8_t* buffer, uint16_t length, CanTxMsgTypeDef* frame) {
+void slcan_receive(uint8_t* buf, uint16_t len) {
+
+    // Command assembled so far
+    static uint8_t command[SLCAN_COMMAND_MAX_LENGTH];
+    static uint8_t command_length = 0;
+    // Set, when a command exceeded the buffer and must be skipped up to its terminator
+    static bool command_overflow = false;
+
+    for (uint16_t i = 0; i < len; i++) {
+        if (input_protocol != SLCAN_PROTOCOL_TEXT) {
+            // A command may switch the protocol, so check for every byte
+            binary_receive(buf[i]);
+        } else if (buf[i] == SLCAN_COMMAND_TERMINATOR) {
+            if (!command_overflow) {
+                command[command_length++] = SLCAN_COMMAND_TERMINATOR;
+                slcan_parse_command(command, command_length);
+            }
+            command_length = 0;
+            command_overflow = false;
+        } else if (command_length < SLCAN_COMMAND_MAX_LENGTH - 1) {
+            command[command_length++] = buf[i];
+        } else {
+            command_overflow = true;
+        }
+    }
+}
+
+
+bool slcan_output(uint8_t* buf, uint16_t len) {
+    #ifdef PC_INTERFACE_USB
+    // Collect as many strings per packet as possible
+    return (CDC_Enqueue_FS(buf, len) == USBD_OK);
+    #endif
+    #ifdef PC_INTERFACE_UART
+    return (_write(0, (char*) buf, len) == len);
+    #endif
+}
+
+
+bool slcan_output_frame(can_frame_t* frame) {
+    if (frame_length == 0)
+        frame_length = slcan_parse_frame(frame, frame_buffer);
+    if (!slcan_output(frame_buffer, frame_length))
+        return false;
+    frame_length = 0;
+    return true;
+}
+
+
+void slcan_process(void) {
+    // Reply taken from the reply buffer, but not yet accepted by the interface to the PC
+    static uint8_t reply[BINARY_MTU];
+    static uint16_t reply_length = 0;
+
+    // Mark the protocol switch in the output, see CANTACT_SET_BINARY_MODE
+    enum slcan_protocol protocol = input_protocol;
+    if (output_protocol != protocol && reply_length == 0 && frame_length == 0) {
+        uint8_t marker = BINARY_DELIMITER;
+        if (slcan_output(&marker, 1)) {
+            output_protocol = protocol;
+            // The PC starts decoding with an empty identifier table as well.
+            binary_reset_compression();
+        }
+    }
+
+    while (true) {
+        if (reply_length == 0) {
+            reply_length = fifo_pop_record(&reply_fifo, reply, SLCAN_MTU);
+            if (reply_length != 0 && output_protocol != SLCAN_PROTOCOL_TEXT) {
+                uint8_t text[SLCAN_MTU];
+                for (uint8_t i=0; i<reply_length; i++)
+                    text[i] = reply[i];
+                reply_length = binary_encode_text(text, reply_length, reply);
+            }
+        }
+        if (reply_length == 0 || !slcan_output(reply, reply_length))
+            break;
+        reply_length = 0;
+    }
+
+    #ifdef PC_INTERFACE_USB
+    // Send the collected strings when the flush timeout has expired
+    CDC_Process_FS();
+    #endif
+}
+
+
+bool slcan_parse_transmit_command(uint8_t* buffer, uint16_t length, can_frame_t* frame) {
 
     if (length == 0)
         // Empty buffer
@@ -203,45 +911,55 @@ bool slcan_parse_transmit_command(uint8_t* buffer, uint16_t length, CanTxMsgType
         // Invalid transmit command
         return false;
 
-    // Parser position in the buffer
-    uint8_t i = 0;
+    bool extended = (buffer[0] == SLCAN_TRANSMIT_EXTENDED) || (buffer[0] == SLCAN_TRANSMIT_REQUEST_EXTENDED);
+    bool remote = (buffer[0] == SLCAN_TRANSMIT_REQUEST_STANDARD) || (buffer[0] == SLCAN_TRANSMIT_REQUEST_EXTENDED);
+    uint8_t id_length = extended ? SLCAN_EXT_ID_LEN : SLCAN_STD_ID_LEN;
 
-    frame->IDE = ((buffer[0] == SLCAN_TRANSMIT_STANDARD) || (buffer[0] == SLCAN_TRANSMIT_REQUEST_STANDARD))
-                    ? CAN_ID_STD
-                    : CAN_ID_EXT;
-
-    frame->RTR = ((buffer[0] == SLCAN_TRANSMIT_REQUEST_STANDARD) || (buffer[0] == SLCAN_TRANSMIT_REQUEST_EXTENDED))
-                    ? CAN_RTR_REMOTE
-                    : CAN_RTR_DATA;
-
-    frame->StdId = 0;
-    frame->ExtId = 0;
-    if (frame->IDE == CAN_ID_STD) {
-        // Parse hexadecimal representation of standard CAN ID
-        for (i=1; i <= SLCAN_STD_ID_LEN; i++) {
-            frame->StdId <<= 4;
-            frame->StdId += hex2int(buffer[i]);
-        }
-    } else {
-        // Parse hexadecimal representation of extended CAN ID
-        for (i=1; i <= SLCAN_EXT_ID_LEN; i++) {
-            frame->ExtId <<= 4;
-            frame->ExtId += hex2int(buffer[i]);
-        }
+    // Command letter, identifier and DLC must be present
+    if (length < 1 + id_length + 1)
+        return false;
+
+    // Parser position in the buffer
+    uint8_t i = 1;
+
+    // Parse hexadecimal representation of the CAN ID
+    frame->id = 0;
+    for (; i <= id_length; i++) {
+        if (!is_hex(buffer[i]))
+            return false;
+        frame->id <<= 4;
+        frame->id += hex2int(buffer[i]);
     }
+    if (frame->id > (extended ? 0x1FFFFFFF : 0x7FF))
+        return false;
 
-    frame->DLC = hex2int(buffer[i++]);
-    if (frame->DLC < 0 || frame->DLC > 8) {
+    if (!is_hex(buffer[i]))
         return false;
-    }
+    frame->dlc = hex2int(buffer[i++]);
+    if (frame->dlc > 8)
+        return false;
+
+    frame->flags = (extended ? CAN_FRAME_FLAG_EXTENDED : 0)
+                 | (remote ? CAN_FRAME_FLAG_REMOTE : 0);
+    frame->timestamp = 0;
 
-    if (i + 1 + frame->DLC*2 > length)
+    // Remote requests carry no data, only a length
+    uint8_t data_length = remote ? 0 : frame->dlc;
+
+    // The data must be followed by nothing but the terminator
+    if ((i + data_length*2 + 1 != length) || (buffer[length-1] != SLCAN_COMMAND_TERMINATOR))
         return false;
 
     // Parse data from hexadecimal representation
-    for (uint8_t j=0; j < frame->DLC; j++, i+=2) {
-        frame->Data[j] = (hex2int(buffer[i]) << 4);
-        frame->Data[j] += hex2int(buffer[i+1]);
+    for (uint8_t j=0; j < 8; j++, i+=2) {
+        if (j >= data_length) {
+            frame->data[j] = 0;
+            continue;
+        }
+        if (!is_hex(buffer[i]) || !is_hex(buffer[i+1]))
+            return false;
+        frame->data[j] = (hex2int(buffer[i]) << 4);
+        frame->data[j] += hex2int(buffer[i+1]);
     }
 
     return true;
@@ -0,0 +1,163 @@
+/**
+ * @file
+ * @brief Free-running microsecond timebase with alarms
+ */
+
+#include "timebase.h"
+#include "platform.h"
+#include "config.h"
+#include "cyclic.h"
+#include "playback.h"
+#include "generator.h"
+#include "filter.h"
+
+
+/**
+ * Per alarm: compare register, interrupt enable and interrupt flag
+ */
+static __IO uint32_t* const alarm_compare[] = {&TIMEBASE_TIMER->CCR1, &TIMEBASE_TIMER->CCR2, &TIMEBASE_TIMER->CCR3, &TIMEBASE_TIMER->CCR4};
+static const uint16_t alarm_interrupt[] = {TIM_DIER_CC1IE, TIM_DIER_CC2IE, TIM_DIER_CC3IE, TIM_DIER_CC4IE};
+static const uint16_t alarm_flag[] = {TIM_SR_CC1IF, TIM_SR_CC2IF, TIM_SR_CC3IF, TIM_SR_CC4IF};
+static const uint16_t alarm_event[] = {TIM_EGR_CC1G, TIM_EGR_CC2G, TIM_EGR_CC3G, TIM_EGR_CC4G};
+
+/**
+ * Number of counter wraparounds, i.e. the upper 32 bits of @ref now_us64
+ */
+static volatile uint32_t wraparounds = 0;
+
+/**
+ * Relation of the device time to the host's clock
+ */
+static uint64_t host_reference = 0;
+static int64_t host_offset = 0;
+static int32_t host_drift = 0;
+
+
+void timebase_init(void)
+{
+    __TIM2_CLK_ENABLE();
+
+    // Count microseconds over the full 32 bit range
+    TIMEBASE_TIMER->CR1 = 0;
+    TIMEBASE_TIMER->PSC = (HAL_RCC_GetPCLK1Freq() / 1000000) - 1;
+    TIMEBASE_TIMER->ARR = 0xFFFFFFFF;
+    TIMEBASE_TIMER->CNT = 0;
+    TIMEBASE_TIMER->DIER = 0;
+
+    // Load the prescaler, then clear the update flag caused hereby
+    TIMEBASE_TIMER->EGR = TIM_EGR_UG;
+    TIMEBASE_TIMER->SR = 0;
+
+    // Count wraparounds
+    TIMEBASE_TIMER->DIER = TIM_DIER_UIE;
+
+    TIMEBASE_TIMER->CR1 = TIM_CR1_CEN;
+
+    HAL_NVIC_SetPriority(TIMEBASE_IRQ, IRQ_PRIORITY_TIMEBASE, 0);
+    HAL_NVIC_EnableIRQ(TIMEBASE_IRQ);
+}
+
+
+uint64_t now_us64(void)
+{
+    uint32_t high, low, overflow;
+
+    // Retry, if the interrupt counted a wraparound meanwhile
+    do {
+        high = wraparounds;
+        low = TIMEBASE_TIMER->CNT;
+        overflow = TIMEBASE_TIMER->SR & TIM_SR_UIF;
+    } while (high != wraparounds);
+
+    // The counter wrapped around, but the interrupt has not counted it yet, e.g. because it is blocked.
+    // The flag is read after the counter, so a value from the upper half was read before the wraparound.
+    if (overflow && ((int32_t) low >= 0))
+        high++;
+
+    return ((uint64_t) high << 32) | low;
+}
+
+
+void timebase_set_host_clock(uint64_t reference, int64_t offset, int32_t drift)
+{
+    enter_critical();
+    host_reference = reference;
+    host_offset = offset;
+    host_drift = drift;
+    exit_critical();
+}
+
+
+uint64_t timebase_to_host(uint64_t time)
+{
+    enter_critical();
+    uint64_t reference = host_reference;
+    int64_t offset = host_offset;
+    int32_t drift = host_drift;
+    exit_critical();
+
+    int64_t elapsed = (int64_t) (time - reference);
+    return time + offset + elapsed * drift / 1000000000;
+}
+
+
+void timebase_set_alarm(enum timebase_alarm alarm, uint32_t time)
+{
+    *alarm_compare[alarm] = time;
+    TIMEBASE_TIMER->SR = ~alarm_flag[alarm];
+    TIMEBASE_TIMER->DIER |= alarm_interrupt[alarm];
+
+    // A compare match only occurs, when the counter reaches the value, not after it has passed it.
+    if (timebase_is_due(time, now_us()))
+        TIMEBASE_TIMER->EGR = alarm_event[alarm];
+}
+
+
+void timebase_trigger_alarm(enum timebase_alarm alarm)
+{
+    // EGR is write-only, so this does not interfere with a concurrent modification of other alarms.
+    TIMEBASE_TIMER->EGR = alarm_event[alarm];
+}
+
+
+void timebase_cancel_alarm(enum timebase_alarm alarm)
+{
+    TIMEBASE_TIMER->DIER &= ~alarm_interrupt[alarm];
+    TIMEBASE_TIMER->SR = ~alarm_flag[alarm];
+}
+
+
+void TIM2_IRQHandler()
+{
+    uint16_t pending = TIMEBASE_TIMER->SR & TIMEBASE_TIMER->DIER;
+
+    if (pending & TIM_SR_UIF)
+    {
+        TIMEBASE_TIMER->SR = ~TIM_SR_UIF;
+        wraparounds++;
+    }
+
+    if (pending & TIM_SR_CC1IF)
+    {
+        TIMEBASE_TIMER->SR = ~TIM_SR_CC1IF;
+        cyclic_alarm();
+    }
+
+    if (pending & TIM_SR_CC2IF)
+    {
+        TIMEBASE_TIMER->SR = ~TIM_SR_CC2IF;
+        playback_alarm();
+    }
+
+    if (pending & TIM_SR_CC3IF)
+    {
+        TIMEBASE_TIMER->SR = ~TIM_SR_CC3IF;
+        generator_alarm();
+    }
+
+    if (pending & TIM_SR_CC4IF)
+    {
+        TIMEBASE_TIMER->SR = ~TIM_SR_CC4IF;
+        filter_alarm();
+    }
+}
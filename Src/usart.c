@@ -12,17 +12,13 @@
 
 UART_HandleTypeDef husart2;
 
-uint8_t uart_rx_buffer[UART_RX_BUFFER_SIZE];
-fifo_t uart_rx_fifo;
-
 uint8_t uart_tx_buffer[UART_TX_BUFFER_SIZE];
 fifo_t uart_tx_fifo;
 
 
 void uart_init()
 {
-    // Initialize FIFO buffers
-    fifo_init(&uart_rx_fifo, uart_rx_buffer, sizeof(uart_rx_buffer));
+    // Initialize FIFO buffer
     fifo_init(&uart_tx_fifo, uart_tx_buffer, sizeof(uart_tx_buffer));
 
     // Enable GPIO clock
@@ -75,26 +71,10 @@ void USART2_IRQHandler()
     if ((husart2.Instance->CR1 & USART_CR1_RXNEIE) > 0
      && (husart2.Instance->ISR & USART_ISR_RXNE) > 0)
     {
-        // Pop byte from UART to FIFO
-        uint8_t rx_byte[2];
-        rx_byte[0] = husart2.Instance->RDR & 0xFF;
+        // Pop byte from UART and append it to the SLCAN command being received
+        uint8_t rx_byte = husart2.Instance->RDR & 0xFF;
         __HAL_UART_SEND_REQ(&husart2, UART_RXDATA_FLUSH_REQUEST);
-
-        // Is there room for one more byte in the FIFO ?
-        if (fifo_has_room(&uart_rx_fifo, 1))
-        {
-            fifo_push(&uart_rx_fifo, rx_byte, 1);
-
-            // Did we receive a complete SLCAN command yet?
-            uint16_t slcan_command_length;
-            if (fifo_has_slcan_command(&uart_rx_fifo, &slcan_command_length))
-            {
-                // Pop the command from the FIFO and perform initial SLCAN parsing!
-                uint8_t slcan_command[SLCAN_MTU+1];
-                fifo_pop(&uart_rx_fifo, slcan_command, slcan_command_length);
-                slcan_parse_command(slcan_command, slcan_command_length);
-            }
-        }
+        slcan_receive(&rx_byte, 1);
     }
 
     if ((husart2.Instance->CR1 & USART_CR1_TXEIE) > 0
@@ -127,12 +107,13 @@ int _read(int file, char *ptr, int len)
 int _write(int file, char *ptr, int len)
 {
     // Append data to USART transmission buffer
-    fifo_push(&uart_tx_fifo, (uint8_t*) ptr, len);
+    if (!fifo_push(&uart_tx_fifo, (uint8_t*) ptr, len))
+        // Not enough room: Nothing was written, the caller may retry later.
+        return 0;
 
     // Enable transmitter buffer ready interrupt
     __HAL_UART_ENABLE_IT(&husart2, UART_IT_TXE);
 
-    // Assume transmission success
     return len;
 }
 
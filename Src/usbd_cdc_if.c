@@ -37,6 +37,9 @@
 #include "usbd_cdc_if.h"
 #include "can.h"
 #include "slcan.h"
+#include "config.h"
+#include "timebase.h"
+#include <string.h>
 
 /** @addtogroup STM32_USB_OTG_DEVICE_LIBRARY
  * @{
@@ -62,8 +65,10 @@
 /* USER CODE BEGIN 1 */
 /* Define size for the receive and transmit buffer over CDC */
 /* It's up to user to redefine and/or remove those define */
-#define APP_RX_DATA_SIZE  32
-#define APP_TX_DATA_SIZE  32
+/* The buffer must hold a complete OUT packet            */
+#define APP_RX_DATA_SIZE  CDC_DATA_FS_OUT_PACKET_SIZE
+#define APP_TX_DATA_SIZE  USB_TX_BUFFER_SIZE
+#define APP_TX_BUFFER_MASK  (USB_TX_BUFFER_COUNT - 1)
 /* USER CODE END 1 */
 /**
  * @}
@@ -87,8 +92,29 @@
 /* Received Data over USB are stored in this buffer       */
 uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 
-/* Send Data over USB CDC are stored in this buffer       */
-uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
+/* Send Data over USB CDC are collected in a ring of      */
+/* buffers: The main loop fills one buffer, while the     */
+/* USB interrupt sends the others, chaining each transfer */
+/* from the completion of the previous one.               */
+uint8_t UserTxBufferFS[USB_TX_BUFFER_COUNT][APP_TX_DATA_SIZE];
+
+/* Number of bytes in each buffer                         */
+uint16_t UserTxLengthFS[USB_TX_BUFFER_COUNT];
+
+/* Free-running count of buffers handed over to the USB   */
+/* interrupt; only written by the main loop               */
+volatile uint8_t UserTxCommitCountFS = 0;
+
+/* Free-running count of buffers completely sent;         */
+/* only written by the USB interrupt                      */
+volatile uint8_t UserTxSentCountFS = 0;
+
+/* Set while a zero-length packet is being sent           */
+volatile uint8_t UserTxZlpFS = 0;
+
+/* Time in microseconds, when the first byte was collected */
+/* in the buffer being filled                             */
+uint32_t UserTxStartTimeFS;
 
 /* USER CODE END 3 */
 
@@ -109,13 +135,15 @@ static int8_t CDC_Init_FS     (void);
 static int8_t CDC_DeInit_FS   (void);
 static int8_t CDC_Control_FS  (uint8_t cmd, uint8_t* pbuf, uint16_t length);
 static int8_t CDC_Receive_FS  (uint8_t* pbuf, uint32_t *Len);
+static int8_t CDC_TransmitCplt_FS (uint8_t* pbuf, uint32_t *Len, uint8_t epnum);
 
 USBD_CDC_ItfTypeDef USBD_Interface_fops_FS =
 {
     CDC_Init_FS,
     CDC_DeInit_FS,
     CDC_Control_FS,
-    CDC_Receive_FS
+    CDC_Receive_FS,
+    CDC_TransmitCplt_FS
 };
 
 /* Private functions ---------------------------------------------------------*/
@@ -131,6 +159,11 @@ static int8_t CDC_Init_FS(void)
     /* USER CODE BEGIN 4 */
     /* Set Application Buffers */
     USBD_CDC_SetRxBuffer(hUsbDevice_0, UserRxBufferFS);
+
+    /* Discard data not sent before a reset or reconfiguration */
+    memset(UserTxLengthFS, 0, sizeof(UserTxLengthFS));
+    UserTxSentCountFS = UserTxCommitCountFS;
+    UserTxZlpFS = 0;
     return (USBD_OK);
     /* USER CODE END 4 */
 }
@@ -244,21 +277,10 @@ static int8_t CDC_Control_FS  (uint8_t cmd, uint8_t* pbuf, uint16_t length)
  * @retval Result of the opeartion: USBD_OK if all operations are OK else USBD_FAIL
  */
 
-uint8_t slcan_str[SLCAN_MTU+1];
-uint8_t slcan_str_index = 0;
-
 static int8_t CDC_Receive_FS (uint8_t* Buf, uint32_t *Len)
 {
     /* USER CODE BEGIN 7 */
-    uint8_t n = *Len;
-    uint8_t i;
-    for (i = 0; i < n; i++) {
-        slcan_str[slcan_str_index++] = Buf[i];
-        if (Buf[i] == SLCAN_COMMAND_TERMINATOR) {
-            slcan_parse_command(slcan_str, slcan_str_index);
-            slcan_str_index = 0;
-        }
-    }
+    slcan_receive(Buf, *Len);
 
     // prepare for next read
     //USBD_CDC_SetRxBuffer(hUsbDevice_0, UserRxBufferFS);
@@ -269,43 +291,185 @@ static int8_t CDC_Receive_FS (uint8_t* Buf, uint32_t *Len)
 }
 
 /**
- * @brief  CDC_Transmit_FS
- *         Data send over USB IN endpoint are sent over CDC interface
- *         through this function.
- *         @note
+ * @brief  CDC_Start_Transfer_FS
+ *         Hands the oldest committed buffer to the IN endpoint,
+ *         unless a transfer is in progress already.
+ *         Must be called from the USB interrupt or with the USB interrupt disabled.
+ */
+static void CDC_Start_Transfer_FS(void)
+{
+    USBD_CDC_HandleTypeDef* hcdc = hUsbDevice_0->pClassData;
+
+    if ((hcdc->TxState != 0) || (UserTxSentCountFS == UserTxCommitCountFS))
+        // Busy or nothing to send
+        return;
+
+    // Transfers longer than one packet are continued from the buffer by the interrupt,
+    // so the buffer must remain untouched until the transfer completes.
+    uint8_t index = UserTxSentCountFS & APP_TX_BUFFER_MASK;
+    USBD_CDC_SetTxBuffer(hUsbDevice_0, UserTxBufferFS[index], UserTxLengthFS[index]);
+    USBD_CDC_TransmitPacket(hUsbDevice_0);
+}
+
+/**
+ * @brief  CDC_TransmitCplt_FS
+ *         Called from the USB interrupt, when a transfer on the IN endpoint has completed.
+ *         Releases the sent buffer and immediately starts the next transfer.
  *
+ *         A transfer, which is an exact multiple of the packet size,
+ *         is only complete for the host after a short packet.
+ *         If no further data is waiting, a zero-length packet is sent to terminate it.
  *
- * @param  Buf: Buffer of data to be send
- * @param  Len: Number of data to be send (in bytes)
- * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL or USBD_BUSY
+ * @param  Buf: Buffer of data sent
+ * @param  Len: Number of data sent (in bytes)
+ * @param  epnum: Endpoint number
+ * @retval USBD_OK
  */
-uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
+static int8_t CDC_TransmitCplt_FS(uint8_t* Buf, uint32_t *Len, uint8_t epnum)
 {
-    uint8_t result = USBD_OK;
-    /* USER CODE BEGIN 8 */
-    uint16_t i;
-
-    for (i=0; i < sizeof(UserTxBufferFS); i++) {
-	UserTxBufferFS[i] = 0;
+    if (UserTxZlpFS)
+    {
+        // Zero-length packet sent
+        UserTxZlpFS = 0;
+    }
+    else
+    {
+        // Release the sent buffer to the main loop, empty
+        uint8_t index = UserTxSentCountFS & APP_TX_BUFFER_MASK;
+        uint16_t length = UserTxLengthFS[index];
+        UserTxLengthFS[index] = 0;
+        __DMB();
+        UserTxSentCountFS++;
+
+        if ((length > 0)
+         && ((length % CDC_DATA_FS_MAX_PACKET_SIZE) == 0)
+         && (UserTxSentCountFS == UserTxCommitCountFS))
+        {
+            UserTxZlpFS = 1;
+            USBD_CDC_SetTxBuffer(hUsbDevice_0, NULL, 0);
+            USBD_CDC_TransmitPacket(hUsbDevice_0);
+            return (USBD_OK);
+        }
     }
 
-    for (i=0; i < Len; i++) {
-	UserTxBufferFS[i] = Buf[i];
+    CDC_Start_Transfer_FS();
+    return (USBD_OK);
+}
+
+/**
+ * @brief  CDC_Enqueue_FS
+ *         Appends data to the buffer being filled for the USB IN endpoint.
+ *         Collecting several SLCAN messages per buffer allows
+ *         more than one message per USB frame to be transferred.
+ *         Full buffers are handed to the endpoint right away,
+ *         others by @ref CDC_Flush_FS or @ref CDC_Process_FS.
+ *
+ * @param  Buf: Buffer of data to be sent
+ * @param  Len: Number of data to be sent (in bytes)
+ * @retval USBD_OK if the data was accepted,
+ *         USBD_BUSY if all buffers are full and waiting for the endpoint
+ */
+uint8_t CDC_Enqueue_FS(uint8_t* Buf, uint16_t Len)
+{
+    if (Len > APP_TX_DATA_SIZE)
+        return USBD_FAIL;
+
+    if ((uint8_t) (UserTxCommitCountFS - UserTxSentCountFS) >= USB_TX_BUFFER_COUNT)
+        // No buffer left to fill
+        return USBD_BUSY;
+
+    uint8_t index = UserTxCommitCountFS & APP_TX_BUFFER_MASK;
+    if (UserTxLengthFS[index] + Len > APP_TX_DATA_SIZE)
+    {
+        // No room left in the current buffer: Hand it over and continue with the next one
+        uint8_t result = CDC_Flush_FS();
+        if (result != USBD_OK)
+            return result;
+        if ((uint8_t) (UserTxCommitCountFS - UserTxSentCountFS) >= USB_TX_BUFFER_COUNT)
+            return USBD_BUSY;
+        index = UserTxCommitCountFS & APP_TX_BUFFER_MASK;
     }
 
-    USBD_CDC_SetTxBuffer(hUsbDevice_0, UserTxBufferFS, Len);
-    result = USBD_CDC_TransmitPacket(hUsbDevice_0);
+    if (UserTxLengthFS[index] == 0)
+        UserTxStartTimeFS = now_us();
+
+    memcpy(&UserTxBufferFS[index][UserTxLengthFS[index]], Buf, Len);
+    UserTxLengthFS[index] += Len;
+
+    if (UserTxLengthFS[index] == APP_TX_DATA_SIZE)
+        // Keep the endpoint busy
+        CDC_Flush_FS();
+
+    return USBD_OK;
+}
+
+/**
+ * @brief  CDC_Flush_FS
+ *         Hands the buffer being filled over to the endpoint
+ *         without waiting for it to fill up.
+ *         Does not wait for the transfer to complete.
+ * @retval USBD_OK if the data was handed over or there was none,
+ *         USBD_BUSY if all buffers are waiting for the endpoint,
+ *         USBD_FAIL if the device has not been configured by the host
+ */
+uint8_t CDC_Flush_FS(void)
+{
+    if ((uint8_t) (UserTxCommitCountFS - UserTxSentCountFS) >= USB_TX_BUFFER_COUNT)
+        // All buffers are waiting for the endpoint, none is being filled
+        return USBD_BUSY;
+
+    uint8_t index = UserTxCommitCountFS & APP_TX_BUFFER_MASK;
+    if (UserTxLengthFS[index] == 0)
+        return USBD_OK;
+
+    if ((hUsbDevice_0 == NULL) || (hUsbDevice_0->pClassData == NULL))
+        // Not configured by the host (yet)
+        return USBD_FAIL;
+
+    // Publish the buffer only after it has been written
+    __DMB();
+    UserTxCommitCountFS++;
+
+    // If the endpoint is idle, the completion of the previous transfer
+    // will not pick up this buffer, so start the transfer here.
+    HAL_NVIC_DisableIRQ(USB_IRQn);
+    CDC_Start_Transfer_FS();
+    HAL_NVIC_EnableIRQ(USB_IRQn);
+
+    return USBD_OK;
+}
 
-/*
-    for (i = 0; i < 1 + (Len/8); i++) {
-	USBD_CDC_SetTxBuffer(hUsbDevice_0, UserTxBufferFS + (8*i), 8);
-	do {
-	    result = USBD_CDC_TransmitPacket(hUsbDevice_0);
-	} while (result != HAL_BUSY);
+/**
+ * @brief  CDC_Process_FS
+ *         Hands the buffer being filled over to the endpoint,
+ *         if its oldest byte has been waiting for @ref USB_TX_FLUSH_TIMEOUT.
+ *         To be called periodically from the main loop.
+ */
+void CDC_Process_FS(void)
+{
+    uint8_t index = UserTxCommitCountFS & APP_TX_BUFFER_MASK;
+    if ((UserTxLengthFS[index] > 0)
+     && (now_us() - UserTxStartTimeFS >= USB_TX_FLUSH_TIMEOUT))
+    {
+        CDC_Flush_FS();
     }
-*/
-    /* USER CODE END 8 */
-    return result;
+}
+
+/**
+ * @brief  CDC_Transmit_FS
+ *         Data send over USB IN endpoint are sent over CDC interface
+ *         through this function, together with any data collected before.
+ *
+ * @param  Buf: Buffer of data to be send
+ * @param  Len: Number of data to be send (in bytes)
+ * @retval Result of the operation: USBD_OK if all operations are OK else USBD_FAIL or USBD_BUSY
+ */
+uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
+{
+    uint8_t result = CDC_Enqueue_FS(Buf, Len);
+    if (result != USBD_OK)
+        return result;
+    return CDC_Flush_FS();
 }
 
 /**
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""
+Reference decoder of the binary host protocol, see Inc/binary.h
+
+Decodes the records the device sends in binary mode (B1) and compressed
+binary mode (B2), and encodes frames to transmit. The decoder mirrors the
+identifier table and the time of the previous frame of the compression,
+both of which start over at the protocol switch marker, an empty record.
+
+Usage as a tool (requires pyserial):
+
+    cantact_binary.py /dev/ttyACM0 [--compressed] [--bitrate 6]
+
+opens the channel and prints the received frames with their device time.
+"""
+
+import argparse
+import sys
+
+DELIMITER = 0x00
+
+KIND_EXTENDED = 0x80
+KIND_REMOTE = 0x40
+KIND_COMPRESSED = 0x20
+KIND_TEXT = 0x10
+KIND_DLC = 0x0F
+
+ID_TABLE_MAX_LENGTH = 128
+
+
+class DecodeError(Exception):
+    pass
+
+
+def cobs_encode(data):
+    """Encodes a record with COBS and appends the delimiter"""
+    out = bytearray([0])
+    code_index = 0
+    for byte in data:
+        if byte == 0:
+            out[code_index] = len(out) - code_index
+            code_index = len(out)
+            out.append(0)
+        else:
+            out.append(byte)
+            if len(out) - code_index == 0xFF:
+                out[code_index] = 0xFF
+                code_index = len(out)
+                out.append(0)
+    out[code_index] = len(out) - code_index
+    out.append(DELIMITER)
+    return bytes(out)
+
+
+def cobs_decode(data):
+    """Decodes a COBS encoded record without its delimiter"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            raise DecodeError("invalid COBS block")
+        out += data[i + 1:i + code]
+        i += code
+        # A block is followed by a zero byte, unless it is full or the last one
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+class Frame:
+    """A CAN frame; time is the device time in microseconds, None for frames to transmit"""
+
+    def __init__(self, id, data=b"", extended=False, remote=False, dlc=None, time=None):
+        self.id = id
+        self.data = bytes(data)
+        self.extended = extended
+        self.remote = remote
+        self.dlc = len(self.data) if dlc is None else dlc
+        self.time = time
+
+    def __eq__(self, other):
+        return (self.id, self.data, self.extended, self.remote, self.dlc, self.time) \
+            == (other.id, other.data, other.extended, other.remote, other.dlc, other.time)
+
+    def __repr__(self):
+        return "Frame(%s%X, %s, dlc=%d, time=%s)" % (
+            "x" if self.extended else "", self.id,
+            "remote" if self.remote else self.data.hex(), self.dlc, self.time)
+
+
+def encode_frame(frame):
+    """Encodes a frame to transmit as a record, ready to be sent to the device"""
+    raw = bytearray([(KIND_EXTENDED if frame.extended else 0)
+                     | (KIND_REMOTE if frame.remote else 0)
+                     | frame.dlc])
+    raw += frame.id.to_bytes(4 if frame.extended else 2, "little")
+    if not frame.remote:
+        raw += frame.data[:frame.dlc]
+    return cobs_encode(raw)
+
+
+def encode_text(command):
+    """Encodes an SLCAN command, including its terminator, as a text record"""
+    return cobs_encode(bytes([KIND_TEXT]) + command.encode())
+
+
+class Decoder:
+    """
+    Splits the byte stream from the device into records and decodes them
+
+    feed() returns a list of the decoded items: Frame objects for received frames
+    and strings for replies to commands. A record, which can not be decoded,
+    raises DecodeError; the stream resynchronizes at the next delimiter.
+    """
+
+    def __init__(self):
+        self.pending = bytearray()
+        self.reset()
+
+    def reset(self):
+        """Starts the compression over, as the device does at the protocol switch marker"""
+        self.id_table = [None] * ID_TABLE_MAX_LENGTH
+        self.time = 0
+
+    def feed(self, data):
+        items = []
+        for byte in data:
+            if byte != DELIMITER:
+                self.pending.append(byte)
+                continue
+            record = bytes(self.pending)
+            self.pending.clear()
+            if not record:
+                # Protocol switch marker
+                self.reset()
+                continue
+            item = self.decode_record(cobs_decode(record))
+            if item is not None:
+                items.append(item)
+        return items
+
+    def decode_record(self, record):
+        kind = record[0]
+        if kind == KIND_TEXT:
+            return record[1:].decode(errors="replace")
+        if kind & KIND_TEXT:
+            raise DecodeError("unknown record kind %02X" % kind)
+
+        extended = bool(kind & KIND_EXTENDED)
+        remote = bool(kind & KIND_REMOTE)
+        dlc = kind & KIND_DLC
+        id_length = 4 if extended else 2
+        reader = _Reader(record, 1)
+
+        if kind & KIND_COMPRESSED:
+            slot = reader.byte()
+            if slot & 0x80:
+                id = reader.number(id_length)
+                self.id_table[slot & 0x7F] = (id, extended)
+            else:
+                if self.id_table[slot] is None:
+                    raise DecodeError("empty identifier slot %d" % slot)
+                id, extended = self.id_table[slot]
+            self.time += reader.zigzag()
+            time = self.time
+        else:
+            id = reader.number(id_length)
+            time = reader.number(4)
+
+        data = b"" if remote else reader.bytes(min(dlc, 8))
+        if not reader.at_end():
+            raise DecodeError("record too long")
+        return Frame(id, data, extended, remote, dlc, time)
+
+
+class _Reader:
+    def __init__(self, record, index):
+        self.record = record
+        self.index = index
+
+    def bytes(self, length):
+        if self.index + length > len(self.record):
+            raise DecodeError("record too short")
+        value = self.record[self.index:self.index + length]
+        self.index += length
+        return value
+
+    def byte(self):
+        return self.bytes(1)[0]
+
+    def number(self, length):
+        return int.from_bytes(self.bytes(length), "little")
+
+    def varint(self):
+        """Unsigned LEB128: 7 bits per byte, least significant first"""
+        value = 0
+        shift = 0
+        while True:
+            byte = self.byte()
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value
+
+    def zigzag(self):
+        """Signed number, zigzag encoded as unsigned LEB128"""
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def at_end(self):
+        return self.index == len(self.record)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("port", help="serial port of the device")
+    parser.add_argument("--compressed", action="store_true", help="compress received frames (B2)")
+    parser.add_argument("--bitrate", default="6", help="SLCAN bitrate code, 0-8 (default 6: 500 kbit/s)")
+    args = parser.parse_args()
+
+    import serial
+    port = serial.Serial(args.port, timeout=0.1)
+    port.write(b"C\r")
+    port.write(b"B2\r" if args.compressed else b"B1\r")
+    # The device switches the input right away; wait for the marker in the output
+    while port.read(1) not in (b"\x00", b""):
+        pass
+    port.write(encode_text("S%s\r" % args.bitrate))
+    port.write(encode_text("O\r"))
+
+    decoder = Decoder()
+    while True:
+        try:
+            items = decoder.feed(port.read(256))
+        except DecodeError as error:
+            print("# %s" % error, file=sys.stderr)
+            continue
+        for item in items:
+            if isinstance(item, Frame):
+                print("%12d %s%8X [%d] %s" % (item.time, "x" if item.extended else " ", item.id,
+                                              item.dlc, "remote" if item.remote else item.data.hex(" ")))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
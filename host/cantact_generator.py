@@ -0,0 +1,108 @@
+#!/usr/bin/env python3
+"""
+Drives the bus load generator, see CANTACT_GENERATOR in Inc/slcan.h
+
+Configures the generator, runs it for a while and prints the achieved
+frame rate, lost arbitrations and transmission errors once per second,
+as reported by the device.
+
+    cantact_generator.py /dev/ttyACM0 --load 80 --ids 100-1FF --pattern increment
+
+Requires pyserial.
+"""
+
+import argparse
+import sys
+import time
+
+PATTERNS = {"fixed": 0, "increment": 1, "random": 2}
+
+
+def parse_range(text):
+    first, _, last = text.partition("-")
+    return int(first, 16), int(last or first, 16)
+
+
+def parse_status(line):
+    """Returns (running, frames per second, lost arbitrations, errors) from a 'gr' reply, else None"""
+    line = line.strip()
+    if len(line) != 26 or line[0] != "g" or line[1] not in "01":
+        return None
+    try:
+        return line[1] == "1", int(line[2:10], 16), int(line[10:18], 16), int(line[18:26], 16)
+    except ValueError:
+        return None
+
+
+class Device:
+    def __init__(self, port):
+        import serial
+        self.port = serial.Serial(port, timeout=0.2)
+
+    def command(self, text, expect=lambda reply: reply == ""):
+        """
+        Sends a command and returns its reply, raises on an error reply;
+        received frames in between are skipped, as they do not match expect
+        """
+        self.port.write(text.encode() + b"\r")
+        line = b""
+        deadline = time.monotonic() + 1
+        while time.monotonic() < deadline:
+            byte = self.port.read(1)
+            if byte == b"\a":
+                raise RuntimeError("device rejected '%s'" % text)
+            if byte == b"\r":
+                if expect(line.decode(errors="replace")):
+                    return line.decode()
+                line = b""
+            else:
+                line += byte
+        raise RuntimeError("no reply to '%s'" % text)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("port", help="serial port of the device")
+    parser.add_argument("--bitrate", default="8", help="SLCAN bitrate code, 0-8 (default 8: 1 Mbit/s)")
+    parser.add_argument("--ids", default="100", help="identifier or range, hexadecimal (default 100)")
+    parser.add_argument("--extended", action="store_true", help="send extended frames")
+    parser.add_argument("--pattern", choices=PATTERNS, default="fixed", help="identifier pattern")
+    parser.add_argument("--dlc", default="8", help="DLC or range, e.g. 0-8 (default 8)")
+    parser.add_argument("--payload", choices=PATTERNS, default="increment", help="payload pattern")
+    parser.add_argument("--data", default="0", help="fixed payload resp. counter start, hexadecimal")
+    pacing = parser.add_mutually_exclusive_group()
+    pacing.add_argument("--load", type=int, help="bus load in percent, 1-100")
+    pacing.add_argument("--rate", type=int, help="frames per second")
+    parser.add_argument("--duration", type=float, default=10, help="seconds to run (default 10)")
+    args = parser.parse_args()
+
+    first, last = parse_range(args.ids)
+    dlc_low, dlc_high = (int(x) for x in parse_range(args.dlc))
+
+    device = Device(args.port)
+    device.command("C")
+    device.command("S" + args.bitrate)
+    device.command("O")
+    try:
+        device.command("gi%d%d%08X%08X" % (PATTERNS[args.pattern], args.extended, first, last))
+        device.command("gd%X%X" % (dlc_low, dlc_high))
+        device.command("gp%d%016X" % (PATTERNS[args.payload], int(args.data, 16)))
+        if args.load is not None:
+            device.command("gl%02X" % args.load)
+        else:
+            device.command("gf%08X" % (args.rate or 0))
+        device.command("gs")
+
+        end = time.monotonic() + args.duration
+        while time.monotonic() < end:
+            time.sleep(1)
+            status = parse_status(device.command("gr", lambda reply: parse_status(reply) is not None))
+            print("%s %8d frames/s  %8d lost arbitrations  %8d errors"
+                  % ("running" if status[0] else "stopped", status[1], status[2], status[3]))
+    finally:
+        device.command("gx")
+        device.command("C")
+
+
+if __name__ == "__main__":
+    sys.exit(main())
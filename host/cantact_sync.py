@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+Host side of the clock synchronization, see CANTACT_CLOCK_SYNC in Inc/slcan.h
+
+The host pings the device with its own time, keeps the ping with the shortest
+round trip time of each group of pings and fits a line to the offsets of the
+kept pings: its slope is the drift of the host clock relative to the device
+clock. The estimate converts device times to host time on the host, or is
+handed to the device with 'yc', which then stamps frames in host time (Z3).
+
+Usage as a tool (requires pyserial):
+
+    cantact_sync.py /dev/ttyACM0 [--set]
+
+pings once per second and prints the estimate; --set hands it to the device.
+"""
+
+import argparse
+import sys
+import time
+
+
+def host_time_us():
+    """Returns the host clock in microseconds"""
+    return time.time_ns() // 1000
+
+
+class ClockSync:
+    """
+    Estimates offset and drift of the host clock relative to the device clock
+
+    group:  number of consecutive pings, of which the one with the shortest
+            round trip time is kept; USB and scheduling only ever add delay
+    window: number of kept pings the line is fitted to
+    """
+
+    def __init__(self, group=16, window=64):
+        self.group = group
+        self.window = window
+        self.candidates = []
+        # Kept pings as (device time, offset)
+        self.samples = []
+        self.ping_device_time = None
+        self.offset = None
+        self.drift = 0.0
+
+    @staticmethod
+    def ping_command(host_time):
+        """Returns the ping command for the given host time"""
+        return "yp%016X\r" % (host_time & 0xFFFFFFFFFFFFFFFF)
+
+    @staticmethod
+    def parse_reply(line):
+        """
+        Returns (host time of the ping, device time at reception) from a reply,
+        None if the line is not a reply
+        """
+        line = line.strip()
+        if len(line) != 33 or line[0] != "y":
+            return None
+        try:
+            return int(line[1:17], 16), int(line[17:33], 16)
+        except ValueError:
+            return None
+
+    def add(self, sent, device_time, received):
+        """
+        Adds a ping, which was sent at host time sent, received by the device
+        at device_time and answered at host time received
+        """
+        self.ping_device_time = device_time
+        self.candidates.append((received - sent, device_time, (sent + received) / 2 - device_time))
+        if len(self.candidates) < self.group:
+            return
+        _, kept_time, kept_offset = min(self.candidates)
+        self.candidates = []
+        self.samples.append((kept_time, kept_offset))
+        del self.samples[:-self.window]
+        self._fit()
+
+    def _fit(self):
+        """Least squares fit of the offsets over the device time"""
+        n = len(self.samples)
+        if n < 2:
+            self.drift = 0.0
+            self.offset_reference = self.samples[0][0]
+            self.offset = self.samples[0][1]
+            return
+        # Relative to the first sample, so the squares do not lose precision
+        t0, o0 = self.samples[0]
+        xs = [t - t0 for t, _ in self.samples]
+        ys = [o - o0 for _, o in self.samples]
+        mean_x = sum(xs) / n
+        mean_y = sum(ys) / n
+        sxx = sum((x - mean_x) ** 2 for x in xs)
+        sxy = sum((x - mean_x) * (y - mean_y) for x, y in zip(xs, ys))
+        self.drift = sxy / sxx if sxx else 0.0
+        self.offset_reference = t0
+        self.offset = o0 + mean_y - self.drift * mean_x
+
+    def offset_at(self, device_time):
+        """Returns the offset of the host clock at the given device time"""
+        return self.offset + self.drift * (device_time - self.offset_reference)
+
+    def to_host(self, device_time):
+        """Converts a device time, e.g. of a received frame, to host time"""
+        return device_time + self.offset_at(device_time)
+
+    def set_command(self):
+        """
+        Returns the command handing the estimate to the device,
+        relative to the last ping; send it before the next ping
+        """
+        offset = round(self.offset_at(self.ping_device_time))
+        drift = round(self.drift * 1e9)
+        drift = max(-0x80000000, min(0x7FFFFFFF, drift))
+        return "yc%016X%08X\r" % (offset & 0xFFFFFFFFFFFFFFFF, drift & 0xFFFFFFFF)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("port", help="serial port of the device")
+    parser.add_argument("--set", action="store_true", help="hand the estimate to the device")
+    parser.add_argument("--interval", type=float, default=1.0, help="seconds between pings")
+    args = parser.parse_args()
+
+    import serial
+    port = serial.Serial(args.port, timeout=0.1)
+    sync = ClockSync()
+
+    while True:
+        sent = host_time_us()
+        port.write(ClockSync.ping_command(sent).encode())
+        deadline = time.monotonic() + 0.5
+        while time.monotonic() < deadline:
+            # Received frames may arrive in between; skip them
+            line = port.read_until(b"\r").decode(errors="replace")
+            reply = ClockSync.parse_reply(line)
+            if reply is None or reply[0] != sent:
+                continue
+            sync.add(sent, reply[1], host_time_us())
+            if sync.offset is not None:
+                print("offset %.0f us, drift %.3f ppm" % (sync.offset_at(reply[1]), sync.drift * 1e6))
+                if args.set:
+                    port.write(sync.set_command().encode())
+            break
+        time.sleep(args.interval)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
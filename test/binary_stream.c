@@ -0,0 +1,137 @@
+/**
+ * @file
+ * @brief Writes records encoded by binary.c, for @ref binary_test.py
+ *
+ * Usage: binary_stream EXPECTED > STREAM
+ *
+ * Writes the encoded records to stdout and the frames and replies,
+ * which a decoder must reproduce, to EXPECTED, one per line.
+ * The frames use a few hundred identifiers, so the identifier table
+ * of the compression sees hits, misses and replacements,
+ * and gaps from microseconds to minutes, so the time wraps around 32 bits.
+ * Some frames are older than the frame before, like those the filter policies held back.
+ */
+
+#include "binary.h"
+#include <error.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PLAIN_FRAMES        200
+#define COMPRESSED_FRAMES   20000
+#define IDENTIFIERS         300
+
+// Not used by the encoder
+bool can_send(const can_frame_t* frame) { return true; }
+int8_t slcan_parse_command(uint8_t* buf, uint8_t len) { return SUCCESS; }
+
+static FILE* expected;
+static uint64_t time = 0;
+/** No frame is older than this */
+static uint64_t earliest = 0;
+
+
+static uint32_t random32(void)
+{
+    static uint32_t state = 2463534242UL;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+
+/**
+ * @return Time of the frame without wrapping around
+ */
+static uint64_t make_frame(can_frame_t* frame)
+{
+    uint32_t n = random32() % IDENTIFIERS;
+    frame->flags = (n % 3 == 0) ? CAN_FRAME_FLAG_EXTENDED : 0;
+    frame->id = (frame->flags & CAN_FRAME_FLAG_EXTENDED) ? n * 0x10001 + 0x18DA0000 : n * 5;
+    if (n % 17 == 0)
+        frame->flags |= CAN_FRAME_FLAG_REMOTE;
+    frame->dlc = n % 9;
+    for (uint8_t i=0; i<8; i++)
+        frame->data[i] = (i < frame->dlc) ? random32() : 0;
+
+    // Mostly short gaps, sometimes long ones
+    uint32_t r = random32() % 1000;
+    time += (r < 900) ? random32() % 500 : random32() % 100000000;
+
+    // Held back for up to 50 ms
+    uint64_t frame_time = time;
+    uint32_t age = random32() % 50000;
+    if (random32() % 20 == 0 && time - earliest > age)
+        frame_time -= age;
+    frame->timestamp = frame_time;
+    return frame_time;
+}
+
+
+static void write_record(const uint8_t* buf, uint8_t len)
+{
+    fwrite(buf, 1, len, stdout);
+}
+
+
+static void expect_frame(const can_frame_t* frame, uint64_t frame_time)
+{
+    fprintf(expected, "%s %X %d %s", (frame->flags & CAN_FRAME_FLAG_EXTENDED) ? "x" : "s",
+            (unsigned) frame->id, frame->dlc, (frame->flags & CAN_FRAME_FLAG_REMOTE) ? "r" : "d");
+    if (!(frame->flags & CAN_FRAME_FLAG_REMOTE))
+        for (uint8_t i=0; i<frame->dlc; i++)
+            fprintf(expected, "%02X", frame->data[i]);
+    fprintf(expected, " %llu\n", (unsigned long long) frame_time);
+}
+
+
+static void expect_text(const char* text)
+{
+    uint8_t buf[BINARY_MTU];
+    uint8_t len = 0;
+    while (text[len])
+        len++;
+    write_record(buf, binary_encode_text((const uint8_t*) text, len, buf));
+    fprintf(expected, "text %.*s\n", len - 1, text);
+}
+
+
+int main(int argc, char** argv)
+{
+    uint8_t buf[BINARY_MTU];
+    can_frame_t frame;
+
+    if (argc != 2 || (expected = fopen(argv[1], "w")) == NULL)
+    {
+        fprintf(stderr, "usage: binary_stream EXPECTED > STREAM\n");
+        return 2;
+    }
+
+    // B1: absolute timestamps of 32 bits
+    for (uint32_t i=0; i<PLAIN_FRAMES; i++)
+    {
+        (void) make_frame(&frame);
+        write_record(buf, binary_encode_frame(&frame, buf));
+        expect_frame(&frame, frame.timestamp);
+    }
+    expect_text("V0101\r");
+
+    // B2: the marker starts the compression over at time zero
+    write_record((const uint8_t*) "", 1);
+    binary_reset_compression();
+    uint64_t start = time - (uint32_t) time;
+    earliest = start;
+    for (uint32_t i=0; i<COMPRESSED_FRAMES; i++)
+    {
+        uint64_t frame_time = make_frame(&frame);
+        write_record(buf, binary_encode_compressed_frame(&frame, buf));
+        // The decoder accumulates the deltas from zero, i.e. the 32 bit time extended without wrapping
+        expect_frame(&frame, frame_time - start);
+        if (i % 1000 == 0)
+            expect_text("z\r");
+    }
+
+    fclose(expected);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""
+Checks the reference decoder in host/cantact_binary.py against the encoder of the firmware
+
+binary_stream, built from Src/binary.c, writes a stream of plain and compressed
+records together with the frames and replies they encode.
+The decoder must reproduce all of them, in order.
+"""
+
+import os
+import subprocess
+import sys
+import tempfile
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "host"))
+from cantact_binary import Decoder, Frame, cobs_decode, cobs_encode
+
+
+def describe(item):
+    if not isinstance(item, Frame):
+        return "text %s" % item.rstrip("\r")
+    return "%s %X %d %s%s %d" % ("x" if item.extended else "s", item.id, item.dlc,
+                                 "r" if item.remote else "d", item.data.hex().upper(), item.time)
+
+
+def main():
+    stream_tool = sys.argv[1]
+    with tempfile.NamedTemporaryFile("r") as expected_file:
+        stream = subprocess.run([stream_tool, expected_file.name], stdout=subprocess.PIPE, check=True).stdout
+        expected = expected_file.read().splitlines()
+
+    decoded = [describe(item) for item in Decoder().feed(stream)]
+    mismatches = [i for i, (a, b) in enumerate(zip(decoded, expected)) if a != b]
+
+    # COBS with full blocks, which the firmware never produces
+    record = bytes(range(1, 256)) * 2 + b"\x00\x01"
+    cobs_ok = cobs_decode(cobs_encode(record)[:-1]) == record
+
+    ok = len(decoded) == len(expected) and not mismatches and cobs_ok
+    print("binary decoder: %d records, %d bytes %s" % (len(decoded), len(stream), "ok" if ok else "FAIL"))
+    if mismatches:
+        i = mismatches[0]
+        print("  record %d: decoded '%s', expected '%s'" % (i, decoded[i], expected[i]))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
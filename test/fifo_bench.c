@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @brief Cost of the byte FIFO per frame, compared to the former modulo implementation
+ *
+ * A frame is a 22 byte SLCAN message with 8 data bytes and its terminator.
+ * Frames are pushed in bursts of four and popped again, so the indices
+ * wrap around at every position of the buffer.
+ *
+ * On x86 the cost is counted in TSC cycles, elsewhere in nanoseconds.
+ * The host divides in hardware, while the Cortex-M0 calls a libgcc routine
+ * of several dozen cycles for every modulo, so the baseline is considerably
+ * slower on the device than the ratio measured here.
+ */
+
+#include "fifo.h"
+#include "fifo_modulo.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT  "cycles"
+static inline uint64_t bench_now(void) { return __rdtsc(); }
+#else
+#define BENCH_UNIT  "ns"
+static inline uint64_t bench_now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+#endif
+
+#define FRAMES      1000000
+#define BURST       4
+#define BUFFER_SIZE 256
+
+static uint8_t message[] = "t12381122334455667788\r";
+#define MESSAGE_LENGTH  (sizeof(message) - 1)
+
+
+static double bench_modulo(void)
+{
+    static uint8_t buffer[BUFFER_SIZE];
+    uint8_t data[MESSAGE_LENGTH];
+    modulo_fifo_t fifo;
+    modulo_fifo_init(&fifo, buffer, sizeof(buffer));
+
+    uint64_t start = bench_now();
+    for (uint32_t frame=0; frame<FRAMES; frame+=BURST)
+    {
+        for (uint8_t i=0; i<BURST; i++)
+            modulo_fifo_push(&fifo, message, MESSAGE_LENGTH);
+        for (uint8_t i=0; i<BURST; i++)
+            modulo_fifo_pop(&fifo, data, MESSAGE_LENGTH);
+    }
+    return (double) (bench_now() - start) / FRAMES;
+}
+
+
+static double bench_mask(void)
+{
+    static uint8_t buffer[BUFFER_SIZE];
+    uint8_t data[MESSAGE_LENGTH];
+    fifo_t fifo;
+    fifo_init(&fifo, buffer, sizeof(buffer));
+
+    uint64_t start = bench_now();
+    for (uint32_t frame=0; frame<FRAMES; frame+=BURST)
+    {
+        for (uint8_t i=0; i<BURST; i++)
+            fifo_push(&fifo, message, MESSAGE_LENGTH);
+        for (uint8_t i=0; i<BURST; i++)
+            fifo_pop(&fifo, data, MESSAGE_LENGTH);
+    }
+    return (double) (bench_now() - start) / FRAMES;
+}
+
+
+int main(void)
+{
+    // Warm up caches and the clock frequency
+    bench_modulo();
+    bench_mask();
+
+    double modulo = bench_modulo();
+    double mask = bench_mask();
+    printf("%u byte frames, pushed and popped, %s per frame:\n", (unsigned) MESSAGE_LENGTH, BENCH_UNIT);
+    printf("  modulo (former)  %8.1f\n", modulo);
+    printf("  mask and memcpy  %8.1f\n", mask);
+    printf("  speedup          %8.1fx\n", modulo / mask);
+    return 0;
+}
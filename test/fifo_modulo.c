@@ -0,0 +1,90 @@
+/**
+ * @file
+ * @brief The byte FIFO before power-of-two sizes, kept as baseline for @ref fifo_bench.c
+ *
+ * Every index step is a modulo, which the Cortex-M0 computes in software,
+ * and the room check loops over the requested length.
+ */
+
+#include "fifo_modulo.h"
+#include "stm32f0xx_hal.h"
+
+
+void modulo_fifo_init(modulo_fifo_t* fifo, uint8_t* buffer, uint16_t size)
+{
+    fifo->buffer = buffer;
+    fifo->size = size;
+    fifo->push_index = 0;
+    fifo->pop_index = 0;
+}
+
+
+static bool modulo_fifo_has_room(modulo_fifo_t* fifo, uint8_t length)
+{
+    // The buffer can't store more than buffer size-1 bytes.
+    if (length+1 >= fifo->size)
+        return false;
+
+    // The buffer is full, when pushing any amount of bytes between 1 and length+1
+    // would increment the push_index to match the pop_index.
+    uint16_t push_index = fifo->push_index;
+    uint16_t pop_index = fifo->pop_index;
+    for (uint16_t l=1; l<=length+1; l++)
+    {
+        if ((push_index + l) % fifo->size == pop_index)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static uint16_t modulo_fifo_get_length(modulo_fifo_t* fifo)
+{
+    uint16_t push_index = fifo->push_index;
+    uint16_t pop_index = fifo->pop_index;
+
+    if (push_index < pop_index)
+    {
+        return (push_index + fifo->size) - pop_index;
+    }
+    return push_index - pop_index;
+}
+
+
+bool modulo_fifo_push(modulo_fifo_t* fifo, uint8_t* data, uint16_t length)
+{
+    if (!modulo_fifo_has_room(fifo, length))
+        return false;
+
+    uint16_t push_index = fifo->push_index;
+    for (uint16_t i=0; i<length; i++)
+    {
+        fifo->buffer[push_index] = data[i];
+        push_index = (push_index + 1) % fifo->size;
+    }
+
+    __DMB();
+    fifo->push_index = push_index;
+    return true;
+}
+
+
+bool modulo_fifo_pop(modulo_fifo_t* fifo, uint8_t* data, uint16_t length)
+{
+    if (modulo_fifo_get_length(fifo) < length)
+        return false;
+
+    __DMB();
+    uint16_t pop_index = fifo->pop_index;
+    for (uint16_t i=0; i<length; i++)
+    {
+        data[i] = fifo->buffer[pop_index];
+        pop_index = (pop_index + 1) % fifo->size;
+    }
+
+    __DMB();
+    fifo->pop_index = pop_index;
+    return true;
+}
@@ -0,0 +1,23 @@
+/**
+ * @file
+ * @brief The byte FIFO before power-of-two sizes, kept as baseline for @ref fifo_bench.c
+ */
+
+#ifndef FIFO_MODULO_H
+#define FIFO_MODULO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint8_t* buffer;
+    uint16_t size;
+    volatile uint16_t push_index;
+    volatile uint16_t pop_index;
+} modulo_fifo_t;
+
+void modulo_fifo_init(modulo_fifo_t* fifo, uint8_t* buffer, uint16_t size);
+bool modulo_fifo_push(modulo_fifo_t* fifo, uint8_t* data, uint16_t length);
+bool modulo_fifo_pop(modulo_fifo_t* fifo, uint8_t* data, uint16_t length);
+
+#endif
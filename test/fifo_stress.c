@@ -0,0 +1,209 @@
+/**
+ * @file
+ * @brief Concurrent stress test of the byte and frame FIFOs
+ *
+ * A producer and a consumer thread stand in for the interrupt and the main loop.
+ * Unlike on the device, both run truly in parallel, which exercises
+ * the interleavings, that an interrupt can produce, much more often.
+ * The consumer checks, that every record and frame arrives exactly once,
+ * in order and complete.
+ *
+ * Waiting sides yield, so the test also makes progress on a single core,
+ * where the threads are preempted at arbitrary points like an interrupt would.
+ */
+
+#include "fifo.h"
+#include "frame_fifo.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORD_COUNT    2000000
+#define FRAME_COUNT     2000000
+#define MAX_RECORD      30
+
+static uint8_t byte_buffer[64];
+static fifo_t byte_fifo;
+
+static can_frame_t frame_buffer[5];
+static frame_fifo_t frame_fifo;
+
+static int failures = 0;
+
+
+static void fail(const char* what, uint32_t sequence)
+{
+    fprintf(stderr, "FAIL: %s at %u\n", what, (unsigned) sequence);
+    failures++;
+}
+
+
+/**
+ * Fills a record, whose length and content are derived from its sequence number
+ */
+static uint8_t make_record(uint32_t sequence, uint8_t* data)
+{
+    uint8_t length = 1 + sequence % MAX_RECORD;
+    for (uint8_t i=0; i<length; i++)
+        data[i] = (uint8_t) (sequence * 31 + i);
+    return length;
+}
+
+
+static void make_frame(uint32_t sequence, can_frame_t* frame)
+{
+    memset(frame, 0, sizeof(*frame));
+    frame->id = sequence & 0x1FFFFFFF;
+    frame->timestamp = sequence;
+    frame->dlc = sequence % 9;
+    for (uint8_t i=0; i<8; i++)
+        frame->data[i] = (uint8_t) (sequence + i);
+}
+
+
+static void* produce_records(void* arg)
+{
+    uint8_t data[MAX_RECORD];
+    for (uint32_t sequence=0; sequence<RECORD_COUNT; sequence++)
+    {
+        uint8_t length = make_record(sequence, data);
+        while (!fifo_push_record(&byte_fifo, data, length))
+            sched_yield();
+    }
+    return NULL;
+}
+
+
+static void consume_records(void)
+{
+    uint8_t data[MAX_RECORD], expected[MAX_RECORD];
+    for (uint32_t sequence=0; sequence<RECORD_COUNT && failures<10; sequence++)
+    {
+        uint16_t length;
+        while ((length = fifo_pop_record(&byte_fifo, data, sizeof(data))) == 0)
+            sched_yield();
+        if (length != make_record(sequence, expected) || memcmp(data, expected, length) != 0)
+            fail("record", sequence);
+    }
+}
+
+
+static void* produce_bytes(void* arg)
+{
+    uint8_t data[MAX_RECORD];
+    uint32_t sent = 0;
+    for (uint32_t sequence=0; sent<RECORD_COUNT; sequence++)
+    {
+        // Chunks of varying length, so the copies wrap at every position
+        uint16_t length = 1 + sequence % MAX_RECORD;
+        for (uint16_t i=0; i<length; i++)
+            data[i] = (uint8_t) (sent + i);
+        while (!fifo_push(&byte_fifo, data, length))
+            sched_yield();
+        sent += length;
+    }
+    return NULL;
+}
+
+
+static void consume_bytes(uint32_t total)
+{
+    uint8_t data[MAX_RECORD];
+    uint32_t received = 0;
+    for (uint32_t sequence=0; received<total && failures<10; sequence++)
+    {
+        // Read in chunks of another length than written
+        uint16_t length = 1 + sequence % 17;
+        if (length > total - received)
+            length = total - received;
+        while (!fifo_pop(&byte_fifo, data, length))
+            sched_yield();
+        for (uint16_t i=0; i<length; i++)
+            if (data[i] != (uint8_t) (received + i))
+                fail("byte", received + i);
+        received += length;
+    }
+}
+
+
+static void* produce_frames(void* arg)
+{
+    can_frame_t frame;
+    for (uint32_t sequence=0; sequence<FRAME_COUNT; sequence++)
+    {
+        make_frame(sequence, &frame);
+        while (!frame_fifo_push(&frame_fifo, &frame))
+            sched_yield();
+    }
+    return NULL;
+}
+
+
+static void consume_frames(void)
+{
+    can_frame_t frame, expected;
+    for (uint32_t sequence=0; sequence<FRAME_COUNT && failures<10; sequence++)
+    {
+        make_frame(sequence, &expected);
+        if (sequence & 1)
+        {
+            while (!frame_fifo_pop(&frame_fifo, &frame))
+                sched_yield();
+        }
+        else
+        {
+            // The peek and commit path used by can_process_rx
+            can_frame_t* oldest;
+            while ((oldest = frame_fifo_peek(&frame_fifo)) == NULL)
+                sched_yield();
+            frame = *oldest;
+            frame_fifo_commit_pop(&frame_fifo);
+        }
+        if (memcmp(&frame, &expected, sizeof(frame)) != 0)
+            fail("frame", sequence);
+    }
+}
+
+
+/**
+ * Runs the producer in a thread and the consumer in this one
+ */
+static void run(const char* name, void* (*producer)(void*), void (*consumer)(void))
+{
+    pthread_t thread;
+    int previous_failures = failures;
+    if (pthread_create(&thread, NULL, producer, NULL) != 0)
+    {
+        perror("pthread_create");
+        exit(2);
+    }
+    consumer();
+    pthread_join(thread, NULL);
+    printf("%-8s %s\n", name, failures > previous_failures ? "FAIL" : "ok");
+}
+
+
+static void consume_all_bytes(void)
+{
+    uint32_t total = 0;
+    for (uint32_t sequence=0; total<RECORD_COUNT; sequence++)
+        total += 1 + sequence % MAX_RECORD;
+    consume_bytes(total);
+}
+
+
+int main(void)
+{
+    fifo_init(&byte_fifo, byte_buffer, sizeof(byte_buffer));
+    run("records", produce_records, consume_records);
+
+    fifo_init(&byte_fifo, byte_buffer, sizeof(byte_buffer));
+    run("bytes", produce_bytes, consume_all_bytes);
+
+    frame_fifo_init(&frame_fifo, frame_buffer, sizeof(frame_buffer) / sizeof(frame_buffer[0]));
+    run("frames", produce_frames, consume_frames);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,17 @@
+/**
+ * @file
+ * @brief Host replacement for the HAL header, providing only what the FIFOs use
+ *
+ * On the Cortex-M0, __DMB orders memory accesses against the other side,
+ * i.e. an interrupt. On the host, the other side is a thread on another core,
+ * so a full fence takes its place.
+ */
+
+#ifndef STM32F0XX_HAL_H
+#define STM32F0XX_HAL_H
+
+#include <stdint.h>
+
+#define __DMB()     __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#endif
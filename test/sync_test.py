@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+"""
+Checks the host clock synchronization in host/cantact_sync.py against a simulated device
+
+The device clock runs 80 ppm fast with an arbitrary offset. Both directions of the link
+add up to one USB frame of delay, and every tenth transfer is delayed by several milliseconds
+more, as host scheduling does. After half an hour of pings, device times of the last minutes
+and of the next seconds must map to host time within tens of microseconds.
+"""
+
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), "..", "host"))
+from cantact_sync import ClockSync
+
+DEVICE_RATE = 1 + 80e-6
+DEVICE_OFFSET = -123456789
+TOLERANCE_US = 50
+
+
+def device_time(host_time):
+    return int(host_time * DEVICE_RATE + DEVICE_OFFSET)
+
+
+def delay():
+    delay = 125 + random.uniform(0, 1000)
+    if random.random() < 0.1:
+        delay += random.expovariate(1 / 5000)
+    return delay
+
+
+def main():
+    random.seed(1)
+    sync = ClockSync()
+    host = 5000000000
+    for _ in range(1800):
+        sent = host
+        reception = sent + delay()
+        received = reception + delay()
+        # The device answers with its time at reception
+        sync.add(sent, device_time(reception), int(received))
+        host += 1000000
+
+    worst = 0
+    for t in range(host - 120000000, host + 10000000, 100003):
+        worst = max(worst, abs(sync.to_host(device_time(t)) - t))
+    ok = worst <= TOLERANCE_US
+    print("clock sync: worst error %.1f us, drift %.3f ppm %s" % (worst, sync.drift * 1e6, "ok" if ok else "FAIL"))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())